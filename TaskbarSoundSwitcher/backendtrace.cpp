@@ -0,0 +1,183 @@
+// ----------------------------------------------------------------------------
+// backendtrace.cpp
+// Optional timing trace of every audio backend call made by the app
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "main.h"
+#include "backendtrace.h"
+#include "backendwatchdog.h"
+#include "backgroundtasks.h"
+
+#include <stdio.h>
+#include <mutex>
+#include <Psapi.h>			// GetProcessMemoryInfo()
+#pragma comment(lib, "Psapi.lib")
+
+// trace file state - the trace is off unless started with the /trace switch.
+// Abandoned watchdog calls can still be writing to it at exit, so writes and
+// the close are serialized.
+static FILE*		g_pTraceFile = nullptr;
+static std::mutex	g_TraceFileLock;
+static LONGLONG	g_TraceStartTime = 0;
+static LONGLONG	g_TraceFrequency = 0;
+
+// StartBackendTrace
+// Opens BackendTrace.log next to the config file.  Every backend call made
+// after this is written to it as one tab separated line:
+//	<ms since start>	<operation>	<elapsed us>	<HRESULT>	<detail>
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	0	Success - trace file opened
+//	-1	Failure - trace file could not be opened, tracing stays off
+int StartBackendTrace()
+{
+	std::string fullPathFilename;
+	if (0 != BuildResourceFilenameString(fullPathFilename, "BackendTrace.log"))
+	{
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> lock(g_TraceFileLock);
+	if (0 != fopen_s(&g_pTraceFile, fullPathFilename.c_str(), "w, ccs=UTF-8"))
+	{
+		g_pTraceFile = nullptr;
+		return -1;
+	}
+
+	LARGE_INTEGER value;
+	QueryPerformanceFrequency(&value);
+	g_TraceFrequency = value.QuadPart;
+	QueryPerformanceCounter(&value);
+	g_TraceStartTime = value.QuadPart;
+
+	fputws(L"time_ms\toperation\telapsed_us\thresult\tdetail\n", g_pTraceFile);
+	return 0;
+}
+
+// StopBackendTrace
+// Closes the trace file if one is open.  Backend calls still hung in a driver
+// find the trace off when they finally return.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void StopBackendTrace()
+{
+	std::lock_guard<std::mutex> lock(g_TraceFileLock);
+	if (g_pTraceFile)
+	{
+		fclose(g_pTraceFile);
+		g_pTraceFile = nullptr;
+	}
+}
+
+// IsBackendTraceEnabled
+// Returns true if backend calls are currently being recorded
+bool IsBackendTraceEnabled()
+{
+	return nullptr != g_pTraceFile;
+}
+
+// BackendTraceTimestamp
+// Returns the current performance counter value to be passed back in to
+// TraceBackendCall once the backend call completes.  Returns 0 without
+// touching the counter when tracing is off.
+LONGLONG BackendTraceTimestamp()
+{
+	if (!g_pTraceFile)
+		return 0;
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return now.QuadPart;
+}
+
+// BackendTraceElapsedUs
+// Returns the microseconds since a value BackendTraceTimestamp() returned, or
+// 0 when tracing is off
+double BackendTraceElapsedUs(LONGLONG startTime)
+{
+	if (!g_pTraceFile)
+		return 0.0;
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double)(now.QuadPart - startTime) * 1000000.0 / (double)g_TraceFrequency;
+}
+
+// TraceBackendCall
+// Writes one completed backend call to the trace file
+//
+// Parameters:
+//	operation	Name of the backend call (ie: "SetDefaultEndpoint")
+//	startTime	Value BackendTraceTimestamp() returned before the call
+//	hr			Result of the call
+//	detail		Optional device name/id the call operated on (may be NULL)
+//
+// Return values:
+//	none
+void TraceBackendCall(LPCWSTR operation, LONGLONG startTime, HRESULT hr, LPCWSTR detail)
+{
+	if (!g_pTraceFile)
+		return;
+
+	double sinceStartMs = (double)(startTime - g_TraceStartTime) * 1000.0 / (double)g_TraceFrequency;
+	double elapsedUs = BackendTraceElapsedUs(startTime);
+
+	// the trace may have been stopped since the check above
+	std::lock_guard<std::mutex> lock(g_TraceFileLock);
+	if (!g_pTraceFile)
+		return;
+
+	fwprintf(g_pTraceFile, L"%.3f\t%s\t%.1f\t0x%08lx\t%s\n", sinceStartMs, operation, elapsedUs, (unsigned long)hr, detail ? detail : L"");
+
+	// flush every line so a trace survives the app being killed mid-hang
+	fflush(g_pTraceFile);
+}
+
+// TraceResourceUsage
+// Writes the process' private bytes, working set, handle count, CPU time used 
+// so far, the number of backend calls still holding watchdog state and the 
+// number of queued background tasks to the trace file.  Logged after every
+// switch so a long running trace shows whether any of them keep growing, and
+// around idle trims so the CPU time between two lines shows what the app
+// costs while idle.
+//
+// Parameters:
+//	stage	What the app just did (ie: "Switch")
+//
+// Return values:
+//	none
+void TraceResourceUsage(LPCWSTR stage)
+{
+	if (!g_pTraceFile)
+		return;
+
+	PROCESS_MEMORY_COUNTERS_EX memoryCounters;
+	ZeroMemory(&memoryCounters, sizeof(memoryCounters));
+	GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&memoryCounters, sizeof(memoryCounters));
+
+	DWORD handleCount = 0;
+	GetProcessHandleCount(GetCurrentProcess(), &handleCount);
+
+	// kernel + user time, in 100ns units
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	ULONGLONG cpuTime = 0;
+	if (GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+	{
+		cpuTime = (((ULONGLONG)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime) +
+			(((ULONGLONG)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime);
+	}
+
+	WCHAR usage[256];
+	swprintf_s(usage, L"%s private_bytes=%Iu working_set=%Iu handles=%lu cpu_ms=%.1f live_backend_calls=%ld queued_tasks=%d", stage, memoryCounters.PrivateUsage,
+		memoryCounters.WorkingSetSize, handleCount, (double)cpuTime / 10000.0, GetLiveDeadlineCallCount(), GetBackgroundQueueDepth());
+	TraceBackendCall(L"ResourceUsage", BackendTraceTimestamp(), S_OK, usage);
+}
@@ -0,0 +1,18 @@
+// ----------------------------------------------------------------------------
+// backendtrace.h
+// Optional timing trace of every audio backend call made by the app
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <string>
+
+// Routines used to record backend operations to the trace file
+int StartBackendTrace();
+void StopBackendTrace();
+bool IsBackendTraceEnabled();
+LONGLONG BackendTraceTimestamp();
+double BackendTraceElapsedUs(LONGLONG startTime);
+void TraceBackendCall(LPCWSTR operation, LONGLONG startTime, HRESULT hr, LPCWSTR detail);
+void TraceResourceUsage(LPCWSTR stage);
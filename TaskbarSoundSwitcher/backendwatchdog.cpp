@@ -0,0 +1,444 @@
+// ----------------------------------------------------------------------------
+// backendwatchdog.cpp
+// Runs audio backend calls under a deadline so a hung driver can't freeze
+// the tray icon
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "backendwatchdog.h"
+#include "backendtrace.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+DWORD g_BackendDeadlineMs = DEFAULT_BACKEND_DEADLINE_MS;
+DWORD g_CircuitBreakerCooldownMs = CIRCUIT_BREAKER_COOLDOWN_MS;
+
+// State shared between the caller and the worker thread running one backend
+// call.  Whichever side lets go of it last frees it, so an abandoned call can
+// finish (or stay hung) without touching the caller's stack.
+struct DeadlineCall
+{
+	std::function<HRESULT()> work;
+	HRESULT hr;
+	HANDLE hDone;				// NULL if the call already completed on the caller's thread
+	volatile LONG refCount;
+	std::wstring operation;
+	std::wstring deviceId;
+	ULONGLONG startTick;
+	LONGLONG traceStartTime;
+};
+
+// per-device circuit breaker state, keyed by the encoded device id
+struct CircuitBreaker
+{
+	int consecutiveTimeouts;
+	ULONGLONG openUntil;
+};
+
+static std::map<std::wstring, CircuitBreaker> g_CircuitBreakers;
+static std::mutex g_CircuitBreakerLock;
+
+// number of call states not yet freed - grows if abandoned calls never return
+static volatile LONG g_LiveDeadlineCalls = 0;
+
+// the thread running under a backend budget, and when the budget runs out
+static DWORD g_BudgetThreadId = 0;
+static ULONGLONG g_BudgetEndTick = 0;
+
+
+// ReleaseDeadlineCall
+// Drops one reference to the call state and frees it on the last one
+static void ReleaseDeadlineCall(DeadlineCall* pCall)
+{
+	if (0 == InterlockedDecrement(&pCall->refCount))
+	{
+		if (pCall->hDone)
+			CloseHandle(pCall->hDone);
+		delete pCall;
+		InterlockedDecrement(&g_LiveDeadlineCalls);
+	}
+}
+
+// DeadlineCallThreadProc
+// Worker thread that runs a single backend call in the multithreaded apartment
+static DWORD WINAPI DeadlineCallThreadProc(LPVOID param)
+{
+	DeadlineCall* pCall = (DeadlineCall*)param;
+
+	HRESULT hrInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+	pCall->hr = pCall->work();
+	if (SUCCEEDED(hrInit))
+		CoUninitialize();
+
+	SetEvent(pCall->hDone);
+	ReleaseDeadlineCall(pCall);
+	return 0;
+}
+
+// RecordCallResult
+// Updates the device's circuit breaker after a call finished or timed out
+//
+// Parameters:
+//	deviceId	Encoded id of the device the call was made on (may be NULL)
+//	timedOut	true if the call was abandoned
+//
+// Return values:
+//	true	This timeout just tripped the device's breaker
+//	false	Otherwise
+static bool RecordCallResult(LPCWSTR deviceId, bool timedOut)
+{
+	if (!deviceId)
+		return false;
+
+	std::lock_guard<std::mutex> lock(g_CircuitBreakerLock);
+	if (!timedOut)
+	{
+		g_CircuitBreakers.erase(deviceId);
+		return false;
+	}
+
+	CircuitBreaker& breaker = g_CircuitBreakers[deviceId];
+	breaker.consecutiveTimeouts++;
+	if (CIRCUIT_BREAKER_TRIP_COUNT == breaker.consecutiveTimeouts)
+	{
+		breaker.openUntil = GetTickCount64() + g_CircuitBreakerCooldownMs;
+		return true;
+	}
+	return false;
+}
+
+// IsCircuitOpen
+// Checks whether calls to a device are currently being skipped because it
+// timed out too many times in a row.  Once the cooldown passes the device
+// gets one more try; another timeout re-opens the breaker.
+//
+// Parameters:
+//	deviceId	Encoded id of the device
+//
+// Return values:
+//	true	Calls to the device should not be made right now
+//	false	The device may be called
+bool IsCircuitOpen(LPCWSTR deviceId)
+{
+	std::lock_guard<std::mutex> lock(g_CircuitBreakerLock);
+	std::map<std::wstring, CircuitBreaker>::iterator it = g_CircuitBreakers.find(deviceId);
+	if ((it == g_CircuitBreakers.end()) || (it->second.consecutiveTimeouts < CIRCUIT_BREAKER_TRIP_COUNT))
+		return false;
+
+	if (GetTickCount64() >= it->second.openUntil)
+	{
+		// half-open: allow a single retry
+		it->second.consecutiveTimeouts = CIRCUIT_BREAKER_TRIP_COUNT - 1;
+		return false;
+	}
+	return true;
+}
+
+// BeginBackendBudget
+// Caps how long the calling thread's backend calls may take altogether until
+// EndBackendBudget.  Each call still gets at most g_BackendDeadlineMs, but no
+// call waits past the budget and none are started once it is spent, so a
+// switch that needs several calls can't add their deadlines up.
+//
+// Parameters:
+//	budgetMs	How long the calls may take from now
+//
+// Return values:
+//	none
+void BeginBackendBudget(DWORD budgetMs)
+{
+	g_BudgetEndTick = GetTickCount64() + budgetMs;
+	g_BudgetThreadId = GetCurrentThreadId();
+}
+
+// EndBackendBudget
+// Lifts the calling thread's backend budget
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void EndBackendBudget()
+{
+	if (GetCurrentThreadId() == g_BudgetThreadId)
+		g_BudgetThreadId = 0;
+}
+
+// GetBudgetEndTick
+// Returns when the calling thread's budget runs out, or 0 if it has none
+static ULONGLONG GetBudgetEndTick()
+{
+	return (g_BudgetThreadId && (GetCurrentThreadId() == g_BudgetThreadId)) ? g_BudgetEndTick : 0;
+}
+
+// GetCallWaitEndTick
+// Returns when the caller stops waiting for a call: g_BackendDeadlineMs after
+// it started, or when the caller's backend budget runs out if that is sooner
+//
+// Parameters:
+//	pCall			The call
+//	pBudgetBound	Set to true if the budget is what ends the wait (may be NULL)
+//
+// Return values:
+//	GetTickCount64() value to give up at
+static ULONGLONG GetCallWaitEndTick(const DeadlineCall* pCall, bool* pBudgetBound)
+{
+	ULONGLONG deadlineTick = pCall->startTick + g_BackendDeadlineMs;
+	ULONGLONG budgetEndTick = GetBudgetEndTick();
+	bool budgetBound = budgetEndTick && (budgetEndTick < deadlineTick);
+	if (pBudgetBound)
+		*pBudgetBound = budgetBound;
+	return budgetBound ? budgetEndTick : deadlineTick;
+}
+
+// WaitForAnyCallDone
+// Waits for any of the backend calls' workers to finish until waitEndTick.
+// On a thread with a message queue (the UI thread) the wait also wakes for
+// messages and peeks at the queue, so Windows doesn't take the app for hung
+// and messages sent from other threads are still answered.  Posted messages
+// are left in the queue; they are handled once the caller is done, so a
+// click or timer can't start new work in the middle of a switch.
+//
+// Parameters:
+//	count		Number of calls, at most MAXIMUM_WAIT_OBJECTS - 1
+//	handles		Event each call's worker sets when the call finishes
+//	waitEndTick	GetTickCount64() value to give up at
+//
+// Return values:
+//	Index in handles of a call that finished, -1 if none had by waitEndTick
+static int WaitForAnyCallDone(DWORD count, const HANDLE* handles, ULONGLONG waitEndTick)
+{
+	bool pumpMessages = (FALSE != IsGUIThread(FALSE));
+	for (;;)
+	{
+		ULONGLONG now = GetTickCount64();
+		DWORD remaining = (now < waitEndTick) ? (DWORD)(waitEndTick - now) : 0;
+		DWORD wait;
+		if (!pumpMessages)
+		{
+			wait = WaitForMultipleObjects(count, handles, FALSE, remaining);
+		}
+		else
+		{
+			wait = MsgWaitForMultipleObjects(count, handles, FALSE, remaining, QS_ALLINPUT);
+			if (WAIT_OBJECT_0 + count == wait)
+			{
+				MSG msg;
+				PeekMessage(&msg, NULL, 0, 0, PM_NOREMOVE);
+				continue;
+			}
+		}
+		return (wait < WAIT_OBJECT_0 + count) ? (int)(wait - WAIT_OBJECT_0) : -1;
+	}
+}
+
+// WaitForAnyDeadlineCall
+// Waits until one of the calls can be ended without blocking: it finished,
+// never started a worker, or ran out of time
+//
+// Parameters:
+//	calls	Handles returned by BeginDeadlineCall, at most
+//			MAXIMUM_WAIT_OBJECTS - 1 of them
+//
+// Return values:
+//	Index in calls of the call to end next
+static int WaitForAnyDeadlineCall(const std::vector<HDEADLINECALL>& calls)
+{
+	std::vector<HANDLE> handles;
+	ULONGLONG waitEndTick = ~0ULL;
+	int firstDue = 0;
+	for (int i = 0; i < (int)calls.size(); i++)
+	{
+		// skipped or made directly - its result is already in
+		if (!calls[i]->hDone)
+			return i;
+
+		ULONGLONG endTick = GetCallWaitEndTick(calls[i], NULL);
+		if (endTick < waitEndTick)
+		{
+			waitEndTick = endTick;
+			firstDue = i;
+		}
+		handles.push_back(calls[i]->hDone);
+	}
+
+	int done = WaitForAnyCallDone((DWORD)handles.size(), &handles[0], waitEndTick);
+	return (done >= 0) ? done : firstDue;
+}
+
+// GetLiveDeadlineCallCount
+// Returns the number of backend calls whose state hasn't been freed yet.
+// Outside of a switch this is the number of abandoned calls still hung in
+// a driver.
+LONG GetLiveDeadlineCallCount()
+{
+	return g_LiveDeadlineCalls;
+}
+
+// BeginDeadlineCall
+// Starts a backend call on its own worker thread and returns without waiting
+// for it.  Every call started must be finished with EndDeadlineCall.  The work
+// must only capture by value since it can outlive the caller.
+//
+// Parameters:
+//	operation	Name of the call for the trace log
+//	deviceId	Encoded id of the device the call is made on, or NULL for
+//				calls that aren't tied to one device
+//	work		The backend call
+//
+// Return values:
+//	Handle to pass to EndDeadlineCall
+HDEADLINECALL BeginDeadlineCall(LPCWSTR operation, LPCWSTR deviceId, const std::function<HRESULT()>& work)
+{
+	DeadlineCall* pCall = new DeadlineCall;
+	InterlockedIncrement(&g_LiveDeadlineCalls);
+	pCall->hr = E_FAIL;
+	pCall->hDone = NULL;
+	pCall->refCount = 1;
+	pCall->operation = operation;
+	pCall->deviceId = deviceId ? deviceId : L"";
+	pCall->startTick = GetTickCount64();
+	pCall->traceStartTime = BackendTraceTimestamp();
+
+	if (deviceId && IsCircuitOpen(deviceId))
+	{
+		TraceBackendCall(operation, pCall->traceStartTime, E_BACKEND_CIRCUIT_OPEN, deviceId);
+		pCall->hr = E_BACKEND_CIRCUIT_OPEN;
+		return pCall;
+	}
+
+	// the caller's budget is already spent - don't start what can't be waited for
+	ULONGLONG budgetEndTick = GetBudgetEndTick();
+	if (budgetEndTick && (pCall->startTick >= budgetEndTick))
+	{
+		TraceBackendCall(operation, pCall->traceStartTime, E_BACKEND_TIMEOUT, deviceId);
+		pCall->hr = E_BACKEND_TIMEOUT;
+		return pCall;
+	}
+
+	pCall->work = work;
+	pCall->hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	pCall->refCount = 2;
+
+	HANDLE hThread = pCall->hDone ? CreateThread(NULL, 0, DeadlineCallThreadProc, pCall, 0, NULL) : NULL;
+	if (!hThread)
+	{
+		// no watchdog available - make the call directly rather than not at all
+		if (pCall->hDone)
+			CloseHandle(pCall->hDone);
+		pCall->hDone = NULL;
+		pCall->refCount = 1;
+		pCall->hr = work();
+		return pCall;
+	}
+	CloseHandle(hThread);
+	return pCall;
+}
+
+// EndDeadlineCall
+// Waits for a call started with BeginDeadlineCall until g_BackendDeadlineMs
+// after it was started, or until the caller's backend budget runs out if that
+// is sooner.  A call that misses the deadline is abandoned - its thread is
+// left to finish on its own - and counted against the device's circuit
+// breaker.  A call cut short by the budget is abandoned too, but isn't held
+// against the device.
+//
+// Parameters:
+//	hCall		Handle returned by BeginDeadlineCall.  It is freed by this call.
+//
+// Return values:
+//	HRESULT					Result of the backend call
+//	E_BACKEND_TIMEOUT		The call was abandoned
+//	E_BACKEND_CIRCUIT_OPEN	The call was skipped, the device is still cooling down
+HRESULT EndDeadlineCall(HDEADLINECALL hCall)
+{
+	DeadlineCall* pCall = hCall;
+	LPCWSTR deviceId = pCall->deviceId.empty() ? NULL : pCall->deviceId.c_str();
+
+	HRESULT hr = pCall->hr;
+	if (pCall->hDone)
+	{
+		// whatever is left of this call's deadline and the caller's budget
+		bool budgetBound;
+		ULONGLONG waitEndTick = GetCallWaitEndTick(pCall, &budgetBound);
+
+		if (0 == WaitForAnyCallDone(1, &pCall->hDone, waitEndTick))
+		{
+			hr = pCall->hr;
+			RecordCallResult(deviceId, false);
+		}
+		else
+		{
+			hr = E_BACKEND_TIMEOUT;
+			TraceBackendCall(pCall->operation.c_str(), pCall->traceStartTime, hr, deviceId);
+			if (!budgetBound && RecordCallResult(deviceId, true))
+			{
+				TraceBackendCall(L"CircuitBreakerOpen", BackendTraceTimestamp(), E_BACKEND_CIRCUIT_OPEN, deviceId);
+			}
+		}
+	}
+	ReleaseDeadlineCall(pCall);
+	return hr;
+}
+
+// RunWithDeadline
+// Runs a backend call on a worker thread and waits at most g_BackendDeadlineMs
+// for it.  See BeginDeadlineCall/EndDeadlineCall.
+//
+// Parameters:
+//	operation	Name of the call for the trace log
+//	deviceId	Encoded id of the device the call is made on, or NULL for
+//				calls that aren't tied to one device
+//	work		The backend call
+//
+// Return values:
+//	HRESULT					Result of the backend call
+//	E_BACKEND_TIMEOUT		The call was abandoned
+//	E_BACKEND_CIRCUIT_OPEN	The call was skipped, the device is still cooling down
+HRESULT RunWithDeadline(LPCWSTR operation, LPCWSTR deviceId, const std::function<HRESULT()>& work)
+{
+	return EndDeadlineCall(BeginDeadlineCall(operation, deviceId, work));
+}
+
+// RunDeadlineCallPool
+// Runs count backend calls with at most maxInFlight of them going at once.
+// Calls start in index order, and the next one starts as soon as any running
+// call finishes or is abandoned, so one slow device holds up one slot rather
+// than everything started alongside it.  Results come back in the order the
+// calls end.
+//
+// Parameters:
+//	count		Number of calls
+//	maxInFlight	Most calls running at once, 1 to MAXIMUM_WAIT_OBJECTS - 1
+//	begin		Starts call i with BeginDeadlineCall and returns its handle
+//	end			Given call i's result from EndDeadlineCall
+//
+// Return values:
+//	none
+void RunDeadlineCallPool(int count, int maxInFlight, const std::function<HDEADLINECALL(int)>& begin,
+	const std::function<void(int, HRESULT)>& end)
+{
+	std::vector<HDEADLINECALL> calls;
+	std::vector<int> indexes;
+	int next = 0;
+	while ((next < count) || !calls.empty())
+	{
+		// fill the free slots
+		while ((next < count) && ((int)calls.size() < maxInFlight))
+		{
+			calls.push_back(begin(next));
+			indexes.push_back(next);
+			next++;
+		}
+
+		int slot = WaitForAnyDeadlineCall(calls);
+		end(indexes[slot], EndDeadlineCall(calls[slot]));
+		calls.erase(calls.begin() + slot);
+		indexes.erase(indexes.begin() + slot);
+	}
+}
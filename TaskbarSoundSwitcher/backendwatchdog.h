@@ -0,0 +1,44 @@
+// ----------------------------------------------------------------------------
+// backendwatchdog.h
+// Runs audio backend calls under a deadline so a hung driver can't freeze
+// the tray icon
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <functional>
+
+// how long a backend call may run before it is abandoned (override with /deadline:<ms>)
+#define DEFAULT_BACKEND_DEADLINE_MS		2000
+
+// consecutive timeouts that trip a device's circuit breaker, and how long the
+// device is then left alone before it is tried again
+#define CIRCUIT_BREAKER_TRIP_COUNT		2
+#define CIRCUIT_BREAKER_COOLDOWN_MS		60000
+
+// how long one switch may spend in backend calls altogether, however many it
+// makes - kept under the 5 seconds after which Windows treats the tray app
+// as hung
+#define SWITCH_BACKEND_BUDGET_MS		4000
+
+// results returned in place of the backend call's own HRESULT
+#define E_BACKEND_TIMEOUT				HRESULT_FROM_WIN32(ERROR_TIMEOUT)
+#define E_BACKEND_CIRCUIT_OPEN			HRESULT_FROM_WIN32(ERROR_DEVICE_NOT_AVAILABLE)
+
+extern DWORD g_BackendDeadlineMs;
+extern DWORD g_CircuitBreakerCooldownMs;	// CIRCUIT_BREAKER_COOLDOWN_MS outside of tests
+
+// handle to a backend call started with BeginDeadlineCall
+typedef struct DeadlineCall* HDEADLINECALL;
+
+// Routines used to run a backend call under the watchdog
+HRESULT RunWithDeadline(LPCWSTR operation, LPCWSTR deviceId, const std::function<HRESULT()>& work);
+HDEADLINECALL BeginDeadlineCall(LPCWSTR operation, LPCWSTR deviceId, const std::function<HRESULT()>& work);
+HRESULT EndDeadlineCall(HDEADLINECALL hCall);
+void RunDeadlineCallPool(int count, int maxInFlight, const std::function<HDEADLINECALL(int)>& begin,
+	const std::function<void(int, HRESULT)>& end);
+void BeginBackendBudget(DWORD budgetMs);
+void EndBackendBudget();
+bool IsCircuitOpen(LPCWSTR deviceId);
+LONG GetLiveDeadlineCallCount();
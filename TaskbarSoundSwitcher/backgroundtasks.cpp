@@ -0,0 +1,327 @@
+// ----------------------------------------------------------------------------
+// backgroundtasks.cpp
+// One small pool of COM initialized worker threads that runs the app's
+// background work by priority instead of each feature starting its own thread
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "backgroundtasks.h"
+#include "backendtrace.h"
+
+#include <algorithm>		// std::find
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// one queued piece of work
+struct BackgroundTask
+{
+	std::wstring key;				// a newer task with the same key replaces this one
+	TaskPriority priority;
+	ULONGLONG dueTick;				// GetTickCount64() before which it must not run
+	std::function<void()> work;
+};
+
+// per lane counters for the summary written to the trace log
+struct BackgroundLaneStats
+{
+	unsigned int tasksRun;
+	unsigned int replaced;			// dropped because a newer task had the same key
+	unsigned int cancelled;			// dropped by CancelBackgroundTask or at stop
+	int maxDepth;					// most tasks queued in the lane at once
+	ULONGLONG totalWaitMs;			// time spent queued past the due time
+	ULONGLONG maxWaitMs;
+};
+
+// queue state - everything below is guarded by g_TaskLock
+static std::mutex				g_TaskLock;
+static std::condition_variable	g_TaskAvailable;
+static std::list<BackgroundTask> g_TaskQueue;
+static std::vector<std::wstring> g_RunningKeys;		// keys of the tasks running right now
+static int						g_RunningLowPriority = 0;
+static bool						g_TasksStopping = false;
+static BackgroundLaneStats		g_LaneStats[TASK_PRIORITY_COUNT];
+
+static HANDLE	g_hWorkerThreads[BACKGROUND_WORKER_COUNT];
+static int		g_WorkerCount = 0;
+
+// names used for each lane in the trace log
+static const LPCWSTR g_LaneNames[TASK_PRIORITY_COUNT] =
+{
+	L"high",
+	L"low"
+};
+
+
+// LaneDepth
+// Returns the number of tasks queued in one lane.  g_TaskLock must be held.
+static int LaneDepth(TaskPriority priority)
+{
+	int depth = 0;
+	for (std::list<BackgroundTask>::const_iterator it = g_TaskQueue.begin(); it != g_TaskQueue.end(); ++it)
+	{
+		if (it->priority == priority)
+			depth++;
+	}
+	return depth;
+}
+
+// IsKeyRunning
+// Returns true if a task with the key is running on a worker right now.
+// g_TaskLock must be held.
+static bool IsKeyRunning(const std::wstring& key)
+{
+	return g_RunningKeys.end() != std::find(g_RunningKeys.begin(), g_RunningKeys.end(), key);
+}
+
+// NextRunnableTask
+// Picks the task a worker should run next: the highest priority task that 
+// is due, oldest first.  Low priority tasks are skipped while they already 
+// occupy every worker but one, and a task waits while an older one with the
+// same key is still running so the two never overlap.  g_TaskLock must be
+// held.
+//
+// Parameters:
+//	now			GetTickCount64()
+//	waitMs		Set to how long until the next queued task is due if none is
+//				runnable yet (INFINITE if the queue is empty)
+//
+// Return values:
+//	Iterator of the task to run, or g_TaskQueue.end() if none can run yet
+static std::list<BackgroundTask>::iterator NextRunnableTask(ULONGLONG now, DWORD& waitMs)
+{
+	std::list<BackgroundTask>::iterator best = g_TaskQueue.end();
+	waitMs = INFINITE;
+	for (std::list<BackgroundTask>::iterator it = g_TaskQueue.begin(); it != g_TaskQueue.end(); ++it)
+	{
+		// on the way out whatever is left to flush runs right away
+		if (!g_TasksStopping && (it->dueTick > now))
+		{
+			if (it->dueTick - now < waitMs)
+				waitMs = (DWORD)(it->dueTick - now);
+			continue;
+		}
+		if ((TASK_PRIORITY_HIGH != it->priority) && (g_RunningLowPriority >= BACKGROUND_WORKER_COUNT - 1))
+			continue;
+		if (IsKeyRunning(it->key))
+			continue;
+		if ((best == g_TaskQueue.end()) || (it->priority < best->priority))
+			best = it;
+	}
+	return best;
+}
+
+// BackgroundWorkerThreadProc
+// Runs queued tasks in the multithreaded apartment until the pool is stopped
+// and the queue is empty
+static DWORD WINAPI BackgroundWorkerThreadProc(LPVOID param)
+{
+	HRESULT hrInit = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	std::unique_lock<std::mutex> lock(g_TaskLock);
+	for (;;)
+	{
+		DWORD waitMs;
+		ULONGLONG now = GetTickCount64();
+		std::list<BackgroundTask>::iterator next = NextRunnableTask(now, waitMs);
+		if (next == g_TaskQueue.end())
+		{
+			if (g_TasksStopping && g_TaskQueue.empty())
+				break;
+
+			if (INFINITE == waitMs)
+				g_TaskAvailable.wait(lock);
+			else
+				g_TaskAvailable.wait_for(lock, std::chrono::milliseconds(waitMs));
+			continue;
+		}
+
+		BackgroundTask task = *next;
+		g_TaskQueue.erase(next);
+
+		BackgroundLaneStats& stats = g_LaneStats[task.priority];
+		ULONGLONG waitedMs = (now > task.dueTick) ? now - task.dueTick : 0;
+		stats.tasksRun++;
+		stats.totalWaitMs += waitedMs;
+		if (waitedMs > stats.maxWaitMs)
+			stats.maxWaitMs = waitedMs;
+
+		if (TASK_PRIORITY_HIGH != task.priority)
+			g_RunningLowPriority++;
+		g_RunningKeys.push_back(task.key);
+		lock.unlock();
+
+		task.work();
+
+		lock.lock();
+		g_RunningKeys.erase(std::find(g_RunningKeys.begin(), g_RunningKeys.end(), task.key));
+		if (TASK_PRIORITY_HIGH != task.priority)
+			g_RunningLowPriority--;
+
+		// a task may have been held back for this worker or this key
+		g_TaskAvailable.notify_all();
+	}
+	lock.unlock();
+
+	if (SUCCEEDED(hrInit))
+		CoUninitialize();
+	return 0;
+}
+
+// StartBackgroundTasks
+// Starts the worker threads
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	0	Success - tasks run in the background
+//	-1	Failure - QueueBackgroundTask runs tasks on the caller's thread instead
+int StartBackgroundTasks()
+{
+	g_TasksStopping = false;
+	for (int i = 0; i < BACKGROUND_WORKER_COUNT; i++)
+	{
+		HANDLE hThread = CreateThread(NULL, 0, BackgroundWorkerThreadProc, NULL, 0, NULL);
+		if (hThread)
+			g_hWorkerThreads[g_WorkerCount++] = hThread;
+	}
+	return g_WorkerCount ? 0 : -1;
+}
+
+// QueueBackgroundTask
+// Queues work to run on a worker thread.  A task still queued under the same
+// key is replaced, and the delay starts over, so a burst of requests for the
+// same thing (ie: saving the config file) runs once.  If a task with the key
+// is already running the new one waits for it to finish before it starts.
+//
+// Parameters:
+//	priority	Lane to run the task in
+//	key			Identifies the task for replacing and cancelling it
+//	delayMs		How long to wait before running it (0 for as soon as possible)
+//	work		The task.  It must only capture by value.
+//
+// Return values:
+//	none
+void QueueBackgroundTask(TaskPriority priority, LPCWSTR key, DWORD delayMs, const std::function<void()>& work)
+{
+	if (!g_WorkerCount)
+	{
+		work();
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(g_TaskLock);
+	for (std::list<BackgroundTask>::iterator it = g_TaskQueue.begin(); it != g_TaskQueue.end(); ++it)
+	{
+		if (it->key == key)
+		{
+			g_LaneStats[it->priority].replaced++;
+			g_TaskQueue.erase(it);
+			break;
+		}
+	}
+
+	BackgroundTask task;
+	task.key = key;
+	task.priority = priority;
+	task.dueTick = GetTickCount64() + delayMs;
+	task.work = work;
+	g_TaskQueue.push_back(task);
+
+	int depth = LaneDepth(priority);
+	if (depth > g_LaneStats[priority].maxDepth)
+		g_LaneStats[priority].maxDepth = depth;
+
+	g_TaskAvailable.notify_all();
+}
+
+// CancelBackgroundTask
+// Drops a queued task that hasn't started yet
+//
+// Parameters:
+//	key		The key the task was queued with
+//
+// Return values:
+//	true	The task was dropped
+//	false	No task with that key is queued (it may already be running)
+bool CancelBackgroundTask(LPCWSTR key)
+{
+	std::lock_guard<std::mutex> lock(g_TaskLock);
+	for (std::list<BackgroundTask>::iterator it = g_TaskQueue.begin(); it != g_TaskQueue.end(); ++it)
+	{
+		if (it->key == key)
+		{
+			g_LaneStats[it->priority].cancelled++;
+			g_TaskQueue.erase(it);
+			return true;
+		}
+	}
+	return false;
+}
+
+// GetBackgroundQueueDepth
+// Returns the number of tasks queued and not started yet
+int GetBackgroundQueueDepth()
+{
+	std::lock_guard<std::mutex> lock(g_TaskLock);
+	return (int)g_TaskQueue.size();
+}
+
+// StopBackgroundTasks
+// Stops the workers and writes each lane's task count, queue depth and wait
+// times to the trace log.  Queued tasks are cancelled except the one queued
+// under flushKey, which runs right away without waiting out its delay so 
+// nothing requested before exit (ie: a config write) is lost.  Blocks until
+// that task and any task already running have finished.
+//
+// Parameters:
+//	flushKey	Key of the task that must still run, or NULL for none
+//
+// Return values:
+//	none
+void StopBackgroundTasks(LPCWSTR flushKey)
+{
+	if (!g_WorkerCount)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(g_TaskLock);
+		for (std::list<BackgroundTask>::iterator it = g_TaskQueue.begin(); it != g_TaskQueue.end();)
+		{
+			if (flushKey && (it->key == flushKey))
+			{
+				++it;
+				continue;
+			}
+			g_LaneStats[it->priority].cancelled++;
+			it = g_TaskQueue.erase(it);
+		}
+		g_TasksStopping = true;
+		g_TaskAvailable.notify_all();
+	}
+
+	WaitForMultipleObjects(g_WorkerCount, g_hWorkerThreads, TRUE, INFINITE);
+	for (int i = 0; i < g_WorkerCount; i++)
+	{
+		CloseHandle(g_hWorkerThreads[i]);
+		g_hWorkerThreads[i] = NULL;
+	}
+	g_WorkerCount = 0;
+
+	for (int i = 0; i < TASK_PRIORITY_COUNT; i++)
+	{
+		const BackgroundLaneStats& stats = g_LaneStats[i];
+		if (!stats.tasksRun && !stats.replaced && !stats.cancelled)
+			continue;
+
+		WCHAR summary[256];
+		swprintf_s(summary, L"lane=%s tasks=%u replaced=%u cancelled=%u max_depth=%d avg_wait_ms=%.1f max_wait_ms=%llu",
+			g_LaneNames[i], stats.tasksRun, stats.replaced, stats.cancelled, stats.maxDepth,
+			stats.tasksRun ? (double)stats.totalWaitMs / (double)stats.tasksRun : 0.0, stats.maxWaitMs);
+		TraceBackendCall(L"BackgroundTaskSummary", BackendTraceTimestamp(), S_OK, summary);
+	}
+}
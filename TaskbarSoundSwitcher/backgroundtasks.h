@@ -0,0 +1,30 @@
+// ----------------------------------------------------------------------------
+// backgroundtasks.h
+// One small pool of COM initialized worker threads that runs the app's
+// background work by priority instead of each feature starting its own thread
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <functional>
+
+// number of worker threads.  Low priority tasks may only ever occupy all but
+// one of them, so high priority work never waits behind a slow write.
+#define BACKGROUND_WORKER_COUNT		2
+
+// the priority lanes, highest first
+enum TaskPriority
+{
+	TASK_PRIORITY_HIGH,				// work something user visible is waiting on
+	TASK_PRIORITY_LOW,				// persistence and diagnostics
+	TASK_PRIORITY_COUNT
+};
+
+// Routines used to run work on the background workers.  Audio backend calls
+// that need a deadline still go through the watchdog (backendwatchdog.h).
+int StartBackgroundTasks();
+void QueueBackgroundTask(TaskPriority priority, LPCWSTR key, DWORD delayMs, const std::function<void()>& work);
+bool CancelBackgroundTask(LPCWSTR key);
+int GetBackgroundQueueDepth();
+void StopBackgroundTasks(LPCWSTR flushKey);
@@ -0,0 +1,136 @@
+// ----------------------------------------------------------------------------
+// configwatch.cpp
+// Watches the config folder so edits to AudioSources.cfg are picked up live
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "main.h"
+#include "configwatch.h"
+
+// directory watch state
+static HANDLE		g_hConfigDir = INVALID_HANDLE_VALUE;
+static OVERLAPPED	g_ConfigWatchOverlapped;
+static DWORD		g_ConfigWatchBuffer[1024];		// ReadDirectoryChangesW needs it DWORD aligned
+
+// the only file in the folder the app cares about
+static const WCHAR	g_ConfigFilename[] = L"AudioSources.cfg";
+
+
+// QueueConfigWatch
+// Asks for the next batch of changes in the config folder.  The overlapped
+// event is signaled once there are some.
+static BOOL QueueConfigWatch()
+{
+	HANDLE hEvent = g_ConfigWatchOverlapped.hEvent;
+	ZeroMemory(&g_ConfigWatchOverlapped, sizeof(g_ConfigWatchOverlapped));
+	g_ConfigWatchOverlapped.hEvent = hEvent;
+
+	return ReadDirectoryChangesW(g_hConfigDir, g_ConfigWatchBuffer, sizeof(g_ConfigWatchBuffer), FALSE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &g_ConfigWatchOverlapped, NULL);
+}
+
+// StartConfigWatch
+// Start watching the %APPDATA% config folder.  The message loop waits on the
+// returned event along with its messages and calls ConfigFileChanged when it
+// is signaled.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	Event signaled when the folder changes, or NULL if it can't be watched
+HANDLE StartConfigWatch()
+{
+	std::string dirName;
+	if (0 != BuildResourceFilenameString(dirName, ""))
+		return NULL;
+
+	g_hConfigDir = CreateFileA(dirName.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (INVALID_HANDLE_VALUE == g_hConfigDir)
+		return NULL;
+
+	ZeroMemory(&g_ConfigWatchOverlapped, sizeof(g_ConfigWatchOverlapped));
+	g_ConfigWatchOverlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (!g_ConfigWatchOverlapped.hEvent || !QueueConfigWatch())
+	{
+		StopConfigWatch();
+		return NULL;
+	}
+	return g_ConfigWatchOverlapped.hEvent;
+}
+
+// ConfigFileChanged
+// Called when the watch event is signaled.  Checks whether the change was to
+// the config file and starts watching for the next one.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	true	The config file was (or may have been) written, renamed or replaced
+//	false	Something else in the folder changed (ie: the trace log)
+bool ConfigFileChanged()
+{
+	bool changed = false;
+	DWORD bytes = 0;
+
+	if (GetOverlappedResult(g_hConfigDir, &g_ConfigWatchOverlapped, &bytes, FALSE))
+	{
+		if (0 == bytes)
+		{
+			// too many changes to fit the buffer - any of them could be ours
+			changed = true;
+		}
+		else
+		{
+			size_t nameLength = wcslen(g_ConfigFilename);
+			BYTE* pEntry = (BYTE*)g_ConfigWatchBuffer;
+			for (;;)
+			{
+				FILE_NOTIFY_INFORMATION* pInfo = (FILE_NOTIFY_INFORMATION*)pEntry;
+				if ((pInfo->FileNameLength / sizeof(WCHAR) == nameLength) &&
+					(0 == _wcsnicmp(pInfo->FileName, g_ConfigFilename, nameLength)))
+				{
+					changed = true;
+					break;
+				}
+				if (0 == pInfo->NextEntryOffset)
+					break;
+				pEntry += pInfo->NextEntryOffset;
+			}
+		}
+	}
+
+	ResetEvent(g_ConfigWatchOverlapped.hEvent);
+	QueueConfigWatch();
+	return changed;
+}
+
+// StopConfigWatch
+// Stop watching the config folder
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void StopConfigWatch()
+{
+	if (INVALID_HANDLE_VALUE != g_hConfigDir)
+	{
+		// wait out the cancel so nothing writes to the buffer afterwards
+		DWORD bytes = 0;
+		if (CancelIo(g_hConfigDir))
+			GetOverlappedResult(g_hConfigDir, &g_ConfigWatchOverlapped, &bytes, TRUE);
+
+		CloseHandle(g_hConfigDir);
+		g_hConfigDir = INVALID_HANDLE_VALUE;
+	}
+	if (g_ConfigWatchOverlapped.hEvent)
+	{
+		CloseHandle(g_ConfigWatchOverlapped.hEvent);
+		g_ConfigWatchOverlapped.hEvent = NULL;
+	}
+}
@@ -0,0 +1,13 @@
+// ----------------------------------------------------------------------------
+// configwatch.h
+// Watches the config folder so edits to AudioSources.cfg are picked up live
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+// Routines used to watch the config file for changes made outside the app
+HANDLE StartConfigWatch();
+bool ConfigFileChanged();
+void StopConfigWatch();
@@ -0,0 +1,34 @@
+// ----------------------------------------------------------------------------
+// configwriter.cpp
+// Writes the config file on a background thread so a slow %APPDATA% (ie: a
+// roaming profile on a network share) can't stall the tray icon
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "main.h"
+#include "configwriter.h"
+#include "backgroundtasks.h"
+#include "backendtrace.h"
+
+
+// RequestConfigWrite
+// Asks for the current device list to be saved to the config file.  Returns
+// right away; the write runs on a background worker once no new request has
+// come in for CONFIG_WRITE_COALESCE_MS and covers every request made in the
+// meantime.  A write still pending at exit is done when the workers stop.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void RequestConfigWrite()
+{
+	QueueBackgroundTask(TASK_PRIORITY_LOW, CONFIG_WRITE_TASK_KEY, CONFIG_WRITE_COALESCE_MS, []()
+	{
+		LONGLONG startTime = BackendTraceTimestamp();
+		int result = WriteDeviceToggleStrings();
+		TraceBackendCall(L"ConfigWrite", startTime, (0 == result) ? S_OK : E_FAIL, NULL);
+	});
+}
@@ -0,0 +1,19 @@
+// ----------------------------------------------------------------------------
+// configwriter.h
+// Writes the config file on a background thread so a slow %APPDATA% (ie: a
+// roaming profile on a network share) can't stall the tray icon
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+// changes requested within this long of each other are written once
+#define CONFIG_WRITE_COALESCE_MS	500
+
+// key of the background task that writes the file - the one task still run
+// when the workers stop at exit
+#define CONFIG_WRITE_TASK_KEY		L"ConfigWrite"
+
+// Routines used to save the config file in the background
+void RequestConfigWrite();
@@ -0,0 +1,139 @@
+// ----------------------------------------------------------------------------
+// deploypolicy.cpp
+// Reads the deployment policy file and sorts output devices into the classes
+// it names, kept free of any audio backend calls
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "deploypolicy.h"
+#include "devicelist.h"
+#include "statusblock.h"
+
+#include "Mmdeviceapi.h"	// EndpointFormFactor
+#include <stdio.h>
+#include <algorithm>		// std::transform, std::find
+
+// longest policy file line read - class names are a word each
+#define MAX_POLICY_LINE_LENGTH	256
+
+// names of the device classes in the policy file, in DeviceClass order
+static const LPCWSTR g_DeviceClassNames[DEVICE_CLASS_COUNT] =
+{
+	L"speakers",
+	L"headset",
+	L"hdmi",
+	L"virtual"
+};
+
+// name fragments (lower case) that give away a software device - they
+// usually claim to be speakers
+static const LPCWSTR g_VirtualDeviceNames[] =
+{
+	L"virtual",
+	L"cable",
+	L"voicemeeter",
+	L"remote audio",
+	L"steam streaming"
+};
+
+// name fragments (lower case) of audio carried to a display
+static const LPCWSTR g_HdmiDeviceNames[] =
+{
+	L"hdmi",
+	L"displayport",
+	L"display audio"
+};
+
+
+// NameContainsAny
+// Returns true if the lower case name contains any of the fragments
+static bool NameContainsAny(const std::wstring& lowerName, const LPCWSTR* fragments, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (std::wstring::npos != lowerName.find(fragments[i]))
+			return true;
+	}
+	return false;
+}
+
+// ClassifyAudioOutputDevice
+// Works out what kind of device an output is from its form factor, falling
+// back on its name when the driver doesn't say or says speakers
+//
+// Parameters:
+//	deviceName	The device's friendly name
+//	formFactor	The device's EndpointFormFactor (UnknownFormFactor if it
+//				couldn't be read)
+//
+// Return values:
+//	DEVICE_CLASS_xxx of the device
+int ClassifyAudioOutputDevice(const std::wstring& deviceName, ULONG formFactor)
+{
+	std::wstring lowerName = deviceName;
+	std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+
+	// software devices report whatever form factor they like
+	if (NameContainsAny(lowerName, g_VirtualDeviceNames, ARRAYSIZE(g_VirtualDeviceNames)))
+		return DEVICE_CLASS_VIRTUAL;
+
+	switch (formFactor)
+	{
+	case Headphones:
+	case Headset:
+	case Handset:
+		return DEVICE_CLASS_HEADSET;
+
+	case DigitalAudioDisplayDevice:
+		return DEVICE_CLASS_HDMI;
+	}
+
+	if (NameContainsAny(lowerName, g_HdmiDeviceNames, ARRAYSIZE(g_HdmiDeviceNames)))
+		return DEVICE_CLASS_HDMI;
+	if (DEVICE_ICON_HEADPHONES == GetDeviceIconClass(deviceName))
+		return DEVICE_CLASS_HEADSET;
+	return DEVICE_CLASS_SPEAKERS;
+}
+
+// LoadDeployPolicy
+// Reads a deployment policy file.  Each line names a device class (speakers,
+// headset, hdmi or virtual); the toggle list gets every device of the first
+// class, then every device of the second, and so on.  Classes that aren't
+// listed are left out, and a class listed twice only counts the first time.
+// Blank lines and lines starting with # are ignored.
+//
+// Parameters:
+//	policyFilename	Full path of the policy file
+//	classOrder		Set to the DEVICE_CLASS_xxx listed, in file order
+//
+// Return values:
+//	0	Success - the policy file was read
+//	-1	There is no policy file
+int LoadDeployPolicy(const std::string& policyFilename, std::vector<int>& classOrder)
+{
+	classOrder.clear();
+
+	FILE* fp = nullptr;
+	if ((0 != fopen_s(&fp, policyFilename.c_str(), "r")) || (NULL == fp))
+		return -1;
+
+	wchar_t line[MAX_POLICY_LINE_LENGTH];
+	while (fgetws(line, MAX_POLICY_LINE_LENGTH, fp))
+	{
+		// strip off the newline and any surrounding blanks
+		std::wstring s = line;
+		size_t first = s.find_first_not_of(L" \t\r\n");
+		if ((std::wstring::npos == first) || (L'#' == s[first]))
+			continue;
+		s = s.substr(first, s.find_last_not_of(L" \t\r\n") - first + 1);
+
+		for (int i = 0; i < DEVICE_CLASS_COUNT; i++)
+		{
+			if ((0 == _wcsicmp(s.c_str(), g_DeviceClassNames[i])) && (classOrder.end() == std::find(classOrder.begin(), classOrder.end(), i)))
+				classOrder.push_back(i);
+		}
+	}
+	fclose(fp);
+	return 0;
+}
@@ -0,0 +1,25 @@
+// ----------------------------------------------------------------------------
+// deploypolicy.h
+// Reads the deployment policy file and sorts output devices into the classes
+// it names, kept free of any audio backend calls
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <string>
+#include <vector>
+
+// the kinds of output device a deployment policy can ask for
+enum DeviceClass
+{
+	DEVICE_CLASS_SPEAKERS,			// speakers, line out and anything not listed below
+	DEVICE_CLASS_HEADSET,			// headphones, headsets and handsets
+	DEVICE_CLASS_HDMI,				// audio carried to a display (HDMI/DisplayPort)
+	DEVICE_CLASS_VIRTUAL,			// software devices (virtual cables, mixers, remote audio)
+	DEVICE_CLASS_COUNT
+};
+
+// Routines used to turn a deployment policy into a toggle list
+int ClassifyAudioOutputDevice(const std::wstring& deviceName, ULONG formFactor);
+int LoadDeployPolicy(const std::string& policyFilename, std::vector<int>& classOrder);
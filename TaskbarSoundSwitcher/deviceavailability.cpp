@@ -0,0 +1,210 @@
+// ----------------------------------------------------------------------------
+// deviceavailability.cpp
+// Which toggle list entries are plugged in - the enumeration diff and the
+// availability bitmap scans, kept free of any audio backend calls
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "deviceavailability.h"
+
+#include <unordered_map>
+#include <intrin.h>		// _BitScanForward, _BitScanReverse
+
+
+// AvailableToggleMask
+// Returns the snapshot's availability bitmap limited to the entries that are
+// actually in its toggle list
+static ULONGLONG AvailableToggleMask(const DeviceListSnapshot& deviceList)
+{
+	int count = deviceList.SwitchCount();
+	ULONGLONG toggleListMask = (count >= MAX_TRACKED_TOGGLE_DEVICES) ? ~0ULL : ((1ULL << count) - 1);
+	return deviceList.availableMask & toggleListMask;
+}
+
+// LowestSetBit
+// Returns the index of the lowest set bit of a non-zero mask
+static int LowestSetBit(ULONGLONG mask)
+{
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)mask))
+		return (int)index;
+
+	_BitScanForward(&index, (unsigned long)(mask >> 32));
+	return (int)index + 32;
+}
+
+// HighestSetBit
+// Returns the index of the highest set bit of a non-zero mask
+static int HighestSetBit(ULONGLONG mask)
+{
+	unsigned long index;
+	if (_BitScanReverse(&index, (unsigned long)(mask >> 32)))
+		return (int)index + 32;
+
+	_BitScanReverse(&index, (unsigned long)mask);
+	return (int)index;
+}
+
+// DiffAudioOutputDevices
+// Compares two enumerations by device id in one pass over each
+//
+// Parameters:
+//	oldDevices	The earlier enumeration
+//	newIds		Device ids of the new enumeration
+//	newNames	Friendly names of the new enumeration, same order
+//	diff		Set to the devices that were added, removed or renamed
+//
+// Return values:
+//	none
+void DiffAudioOutputDevices(const DeviceTable& oldDevices, const std::vector<std::wstring>& newIds,
+	const std::vector<std::wstring>& newNames, DeviceListDiff& diff)
+{
+	diff = DeviceListDiff();
+
+	// old devices not seen again are left in the map
+	std::unordered_map<std::wstring, int> oldIndexes(oldDevices.Count());
+	for (int i = 0; i < oldDevices.Count(); i++)
+	{
+		oldIndexes[oldDevices.Id(i)] = i;
+	}
+
+	for (size_t i = 0; i < newIds.size(); i++)
+	{
+		std::unordered_map<std::wstring, int>::iterator it = oldIndexes.find(newIds[i]);
+		if (it == oldIndexes.end())
+		{
+			diff.addedIds.push_back(newIds[i]);
+			diff.addedNames.push_back(newNames[i]);
+		}
+		else
+		{
+			if (newNames[i] != oldDevices.Name(it->second))
+				diff.renamedIds.push_back(newIds[i]);
+			oldIndexes.erase(it);
+		}
+	}
+
+	for (int i = 0; i < oldDevices.Count(); i++)
+	{
+		if (oldIndexes.count(oldDevices.Id(i)))
+			diff.removedIds.push_back(oldDevices.Id(i));
+	}
+}
+
+// MatchActiveDevices
+// Builds an availability bitmap from the active devices found by the last
+// enumeration without enumerating again.  Each device name goes through the
+// toggle list's matcher once.
+//
+// Parameters:
+//	deviceList	The device list snapshot holding the last enumeration
+//
+// Return values:
+//	Bit per toggle list entry, set when an active device matches the entry
+ULONGLONG MatchActiveDevices(const DeviceListSnapshot& deviceList)
+{
+	if (!deviceList.matcher)
+		return 0;
+
+	// one name buffer for every row, so matching doesn't allocate per device
+	std::vector<bool> matched(deviceList.SwitchCount(), false);
+	std::wstring name;
+	for (int i = 0; i < deviceList.activeTable.Count(); i++)
+	{
+		name.assign(deviceList.activeTable.Name(i));
+		deviceList.matcher->Match(name, matched);
+	}
+
+	ULONGLONG mask = 0;
+	for (int i = 0; (i < (int)matched.size()) && (i < MAX_TRACKED_TOGGLE_DEVICES); i++)
+	{
+		if (matched[i])
+			mask |= (1ULL << i);
+	}
+	return mask;
+}
+
+// IsSwitchIndexAvailable
+// Checks the availability bitmap for one toggle list entry
+//
+// Parameters:
+//	deviceList				The device list snapshot to check
+//	deviceSwitchListIndex	The index in the snapshot's switch list
+//
+// Return values:
+//	true	The entry's device is plugged in and active
+//	false	The entry's device is not currently available
+bool IsSwitchIndexAvailable(const DeviceListSnapshot& deviceList, const int deviceSwitchListIndex)
+{
+	if ((deviceSwitchListIndex < 0) || (deviceSwitchListIndex >= deviceList.SwitchCount()))
+		return false;
+	if (deviceSwitchListIndex >= MAX_TRACKED_TOGGLE_DEVICES)
+		return true;
+	return 0 != (deviceList.availableMask & (1ULL << deviceSwitchListIndex));
+}
+
+// NextAvailableSwitchIndex
+// Finds the next available toggle list entry after deviceSwitchListIndex,
+// wrapping around to the start of the list
+//
+// Parameters:
+//	deviceList				The device list snapshot to search
+//	deviceSwitchListIndex	The current index in the switch list (may be -1)
+//
+// Return values:
+//	>=0		Index of the next available entry
+//	-1		None of the entries are available
+int NextAvailableSwitchIndex(const DeviceListSnapshot& deviceList, const int deviceSwitchListIndex)
+{
+	ULONGLONG mask = AvailableToggleMask(deviceList);
+	if (0 == mask)
+		return -1;
+
+	// entries after the current one first, then wrap around
+	int firstAfter = deviceSwitchListIndex + 1;
+	ULONGLONG after = (firstAfter < MAX_TRACKED_TOGGLE_DEVICES) ? (mask & (~0ULL << firstAfter)) : 0;
+	return LowestSetBit(after ? after : mask);
+}
+
+// PreviousAvailableSwitchIndex
+// Finds the closest available toggle list entry before deviceSwitchListIndex,
+// wrapping around to the end of the list
+//
+// Parameters:
+//	deviceList				The device list snapshot to search
+//	deviceSwitchListIndex	The current index in the switch list (may be -1)
+//
+// Return values:
+//	>=0		Index of the previous available entry
+//	-1		None of the entries are available
+int PreviousAvailableSwitchIndex(const DeviceListSnapshot& deviceList, const int deviceSwitchListIndex)
+{
+	ULONGLONG mask = AvailableToggleMask(deviceList);
+	if (0 == mask)
+		return -1;
+
+	// entries before the current one first, then wrap around
+	ULONGLONG before = 0;
+	if (deviceSwitchListIndex >= MAX_TRACKED_TOGGLE_DEVICES)
+		before = mask;
+	else if (deviceSwitchListIndex > 0)
+		before = mask & ((1ULL << deviceSwitchListIndex) - 1);
+	return HighestSetBit(before ? before : mask);
+}
+
+// BestAvailableSwitchIndex
+// Finds the highest priority available entry.  The toggle list order is the
+// priority order, so this is the first available entry in the list.
+//
+// Parameters:
+//	deviceList	The device list snapshot to search
+//
+// Return values:
+//	>=0		Index of the best available entry
+//	-1		None of the entries are available
+int BestAvailableSwitchIndex(const DeviceListSnapshot& deviceList)
+{
+	ULONGLONG mask = AvailableToggleMask(deviceList);
+	return mask ? LowestSetBit(mask) : -1;
+}
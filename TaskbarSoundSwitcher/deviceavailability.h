@@ -0,0 +1,41 @@
+// ----------------------------------------------------------------------------
+// deviceavailability.h
+// Which toggle list entries are plugged in - the enumeration diff and the
+// availability bitmap scans, kept free of any audio backend calls
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <string>
+#include <vector>
+
+#include "devicelist.h"
+
+// number of toggle list entries covered by the availability bitmap
+#define MAX_TRACKED_TOGGLE_DEVICES	64
+
+// DeviceListDiff
+// What changed between two enumerations, keyed by encoded device id so it
+// doesn't depend on the order devices are enumerated in
+struct DeviceListDiff
+{
+	std::vector<std::wstring> addedIds;		// devices that became active
+	std::vector<std::wstring> addedNames;	// their friendly names, same order
+	std::vector<std::wstring> removedIds;	// devices that were unplugged or disabled
+	std::vector<std::wstring> renamedIds;	// still active but under a different name
+
+	bool Empty() const
+	{
+		return addedIds.empty() && removedIds.empty() && renamedIds.empty();
+	}
+};
+
+// Routines used to track which toggle list entries are plugged in
+void DiffAudioOutputDevices(const DeviceTable& oldDevices, const std::vector<std::wstring>& newIds,
+	const std::vector<std::wstring>& newNames, DeviceListDiff& diff);
+ULONGLONG MatchActiveDevices(const DeviceListSnapshot& deviceList);
+bool IsSwitchIndexAvailable(const DeviceListSnapshot& deviceList, const int deviceSwitchListIndex);
+int NextAvailableSwitchIndex(const DeviceListSnapshot& deviceList, const int deviceSwitchListIndex);
+int PreviousAvailableSwitchIndex(const DeviceListSnapshot& deviceList, const int deviceSwitchListIndex);
+int BestAvailableSwitchIndex(const DeviceListSnapshot& deviceList);
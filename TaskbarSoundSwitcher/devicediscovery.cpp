@@ -7,11 +7,21 @@
 #include "stdafx.h"
 #include "main.h"
 #include "devicediscovery.h"
+#include "devicelist.h"
+#include "deviceenumerator.h"
+#include "backendtrace.h"
+#include "backendwatchdog.h"
+#include "switchtiming.h"
+#include "backgroundtasks.h"
+
+#include <memory>
+#include <mutex>
 
 // headers needed for undocumented device discovery routines
 #include "windows.h"
 #include "Mmdeviceapi.h"
 #include "Mmreg.h"
+#include "Audiopolicy.h"
 #include "PolicyConfig.h"
 #include "Propidl.h"
 #include "Functiondiscoverykeys_devpkey.h"
@@ -19,86 +29,439 @@
 #include "Propvarutil.h"	
 #pragma comment(lib, "Propsys.lib")
 
+// set by /movecommunications to move the communications device with a switch
+bool g_MigrateCommunicationsRole = false;
+
+// speculative prefetch of the next toggle target.  The resolve runs on a
+// background worker and hands its result back through g_PrefetchResult; a
+// result whose generation is stale by the time it arrives is thrown away.
+static int					g_PrefetchedIndex = -1;
+static std::wstring			g_PrefetchedDeviceId;
+static UINT					g_PrefetchGeneration = 0;
+static std::mutex			g_PrefetchResultLock;
+static struct
+{
+	UINT			generation;
+	int				index;
+	std::wstring	deviceId;
+	LONGLONG		startTime;
+} g_PrefetchResult = { 0, -1 };
+static IPolicyConfigVista*	g_pWarmPolicyConfig = nullptr;
+static unsigned int			g_PrefetchHits = 0;
+static unsigned int			g_PrefetchMisses = 0;
+
+// set while a switch waits on the backend.  The wait still answers messages
+// sent to the window, and one of those (ie: a forwarded command line) must
+// not start a second switch inside the first.
+static bool					g_SwitchInProgress = false;
+
 // Much of this code is derived from the excellent work done by EreTIk on this
 // blog entry (under the MIT license):
 // http://www.daveamenta.com/2011-05/programmatically-or-command-line-change-the-default-sound-playback-device-in-windows-7/
 
 
-// DiscoverAllAudioOutputDevices
-// Enumerate the list of audio devices and store the string names into 
-// the enumeratedDeviceList
+// BeginReadDeviceProperties
+// Start reading the friendly name, and optionally the form factor, of an
+// audio endpoint from its property store.  The read runs under the backend
+// watchdog since some drivers block in OpenPropertyStore, so several reads
+// can be in flight at once.  Only first run needs the form factor, so other
+// reads skip it rather than give a slow driver a second call to hang in.  A
+// form factor that can't be read is left as UnknownFormFactor without failing
+// the read.
 //
 // Parameters:
-//	enumeratedDeviceList	A list of all audio device name strings.  Strings
-//							match the name displayed in audio control panel
+//	pDevice			The audio endpoint to read
+//	deviceId		Encoded id of the endpoint, used for its circuit breaker
+//	readFormFactor	true to read the form factor as well as the name
+//	properties		Receives the device's friendly name and form factor once
+//					the read succeeds.  The name matches the one displayed in
+//					audio control panel
 //
 // Return values:
-//	none
-void DiscoverAllAudioOutputDevices(std::vector<std::wstring>& enumeratedDeviceList)
+//	Handle to pass to EndDeadlineCall for the HRESULT of the read
+HDEADLINECALL BeginReadDeviceProperties(IMMDevice* pDevice, LPCWSTR deviceId, bool readFormFactor,
+	const std::shared_ptr<DeviceProperties>& properties)
 {
-	// clear the list of devices
-	enumeratedDeviceList.clear();
+	// the read may be abandoned, so it holds its own device reference and
+	// result instead of pointing back into the caller's stack frame
+	pDevice->AddRef();
+	std::shared_ptr<IMMDevice> device(pDevice, [](IMMDevice* p) { p->Release(); });
+	std::shared_ptr<DeviceProperties> result = properties;
 
-	// use undocumented routines to figure out the audio devices
-	HRESULT hr = CoInitialize(NULL);
-	if (SUCCEEDED(hr))
+	return BeginDeadlineCall(L"ReadDeviceProperties", deviceId, [device, readFormFactor, result]() -> HRESULT
 	{
-		IMMDeviceEnumerator *pEnum = NULL;
-		// Create a multimedia device enumerator.
-		hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL,
-			CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&pEnum);
+		IPropertyStore *pStore;
+		LONGLONG startTime = BackendTraceTimestamp();
+		HRESULT hr = device->OpenPropertyStore(STGM_READ, &pStore);
+		TraceBackendCall(L"OpenPropertyStore", startTime, hr, NULL);
 		if (SUCCEEDED(hr))
 		{
-			IMMDeviceCollection *pDevices;
+			PROPVARIANT friendlyName;
+			PropVariantInit(&friendlyName);
+			startTime = BackendTraceTimestamp();
+			hr = pStore->GetValue(PKEY_Device_FriendlyName, &friendlyName);
+			if (SUCCEEDED(hr))
+			{
+				WCHAR szTitle[MAX_DEVICE_STRING_LENGTH];
+				PropVariantToString(friendlyName, szTitle, ARRAYSIZE(szTitle));
+				result->name = szTitle;
+
+				PropVariantClear(&friendlyName);
+			}
+			TraceBackendCall(L"GetValue", startTime, hr, result->name.c_str());
+
+			if (SUCCEEDED(hr) && readFormFactor)
+			{
+				PROPVARIANT formFactor;
+				PropVariantInit(&formFactor);
+				startTime = BackendTraceTimestamp();
+				HRESULT hrFormFactor = pStore->GetValue(PKEY_AudioEndpoint_FormFactor, &formFactor);
+				if (SUCCEEDED(hrFormFactor))
+				{
+					ULONG value;
+					if (SUCCEEDED(PropVariantToUInt32(formFactor, &value)))
+						result->formFactor = value;
+					PropVariantClear(&formFactor);
+				}
+				TraceBackendCall(L"GetValue", startTime, hrFormFactor, result->name.c_str());
+			}
+			pStore->Release();
+		}
+		return hr;
+	});
+}
+
+// ReadDeviceFriendlyName
+// Read the friendly name of an audio endpoint and wait for the result
+//
+// Parameters:
+//	pDevice		The audio endpoint to read
+//	deviceId	Encoded id of the endpoint, used for its circuit breaker
+//	name		Set to the device's friendly name
+//
+// Return values:
+//	HRESULT		Indicates success/failure of the property read
+HRESULT ReadDeviceFriendlyName(IMMDevice* pDevice, LPCWSTR deviceId, std::wstring& name)
+{
+	std::shared_ptr<DeviceProperties> result = std::make_shared<DeviceProperties>();
+	HRESULT hr = EndDeadlineCall(BeginReadDeviceProperties(pDevice, deviceId, false, result));
+	if (SUCCEEDED(hr))
+	{
+		name = result->name;
+	}
+	return hr;
+}
+
+
+// endpoints listed under the watchdog.  The list is shared with the worker
+// that fills it, so an abandoned listing releases its devices whenever it
+// finally finishes.
+struct EndpointList
+{
+	std::vector<IMMDevice*>		devices;
+	std::vector<std::wstring>	ids;
 
-			// Enumerate the output devices.
-			hr = pEnum->EnumAudioEndpoints(eRender, DEVICE_STATE_ACTIVE, &pDevices);
+	~EndpointList()
+	{
+		for (IMMDevice* pDevice : devices)
+			pDevice->Release();
+	}
+};
+
+// ListAudioEndpoints
+// Lists the active output endpoints, or just the default multimedia one, and
+// their ids.  The enumerator calls run under the backend watchdog; the list
+// may only be read when this succeeds.
+//
+// Parameters:
+//	defaultOnly	true to list only the default multimedia endpoint
+//	endpoints	Filled in with the endpoints and their ids
+//
+// Return values:
+//	HRESULT		Indicates success/failure of the listing
+static HRESULT ListAudioEndpoints(bool defaultOnly, const std::shared_ptr<EndpointList>& endpoints)
+{
+	HRESULT hr = CreateAudioDeviceEnumerator();
+	if (FAILED(hr))
+		return hr;
+
+	LPCWSTR operation = defaultOnly ? L"GetDefaultAudioEndpoint" : L"EnumAudioEndpoints";
+	return RunWithDeadline(operation, NULL, [defaultOnly, endpoints, operation]() -> HRESULT
+	{
+		// the worker's own apartment gets its own enumerator pointer
+		IMMDeviceEnumerator* pEnumerator = nullptr;
+		HRESULT hr = GetAudioDeviceEnumerator(&pEnumerator);
+		if (FAILED(hr))
+			return hr;
+		std::shared_ptr<IMMDeviceEnumerator> enumerator(pEnumerator, [](IMMDeviceEnumerator* p) { p->Release(); });
+
+		LONGLONG startTime = BackendTraceTimestamp();
+		if (defaultOnly)
+		{
+			IMMDevice* pDevice = nullptr;
+			hr = enumerator->GetDefaultAudioEndpoint(eRender, eMultimedia, &pDevice);
+			if (SUCCEEDED(hr) && pDevice)
+				endpoints->devices.push_back(pDevice);
+		}
+		else
+		{
+			IMMDeviceCollection *pDevices;
+			hr = enumerator->EnumAudioEndpoints(eRender, DEVICE_STATE_ACTIVE, &pDevices);
 			if (SUCCEEDED(hr))
 			{
 				UINT count;
 				hr = pDevices->GetCount(&count);
-				if (SUCCEEDED(hr))
+				for (UINT i = 0; SUCCEEDED(hr) && (i < count); i++)
+				{
+					IMMDevice *pDevice;
+					if (SUCCEEDED(pDevices->Item(i, &pDevice)))
+						endpoints->devices.push_back(pDevice);
+				}
+				pDevices->Release();
+			}
+		}
+		TraceBackendCall(operation, startTime, hr, NULL);
+
+		// drop any endpoint whose id can't be read
+		for (size_t i = 0; i < endpoints->devices.size();)
+		{
+			LPWSTR wstrID = NULL;
+			if (SUCCEEDED(endpoints->devices[i]->GetId(&wstrID)))
+			{
+				endpoints->ids.push_back(wstrID);
+				CoTaskMemFree(wstrID);
+				i++;
+			}
+			else
+			{
+				endpoints->devices[i]->Release();
+				endpoints->devices.erase(endpoints->devices.begin() + i);
+			}
+		}
+		return hr;
+	});
+}
+
+
+// ReadAudioOutputDevices
+// Enumerate the active audio output devices and read each one's friendly
+// name, and its form factor if asked for.  Up to PARALLEL_PROPERTY_READS
+// property reads run at once, and the next one starts as soon as any of them
+// finishes, so slow endpoints (Bluetooth, virtual devices) overlap instead of
+// adding up and don't hold up the reads queued behind them.
+// Results keep the enumeration order.  A device whose read was abandoned by
+// the watchdog is still there, so it keeps the name it had at the last
+// enumeration and an unknown form factor; devices whose name could not be
+// read otherwise are left out of the lists.
+//
+// Parameters:
+//	deviceIds		Set to the encoded device id of each device
+//	deviceNames		Set to the friendly name of each device
+//	pFormFactors	Set to the EndpointFormFactor of each device, or NULL to
+//					skip reading them
+//
+// Return values:
+//	HRESULT		Indicates success/failure of the enumeration
+static HRESULT ReadAudioOutputDevices(std::vector<std::wstring>& deviceIds, std::vector<std::wstring>& deviceNames,
+	std::vector<ULONG>* pFormFactors)
+{
+	deviceIds.clear();
+	deviceNames.clear();
+	if (pFormFactors)
+		pFormFactors->clear();
+
+	// last known names for devices that stop answering
+	DeviceListSnapshotPtr lastEnumeration = AcquireDeviceList();
+
+	// use undocumented routines to figure out the audio devices.  Background
+	// workers are already in the MTA, which does just as well.
+	HRESULT hrInit = CoInitialize(NULL);
+	HRESULT hr = (RPC_E_CHANGED_MODE == hrInit) ? S_OK : hrInit;
+	if (SUCCEEDED(hr))
+	{
+		std::shared_ptr<EndpointList> endpoints = std::make_shared<EndpointList>();
+		hr = ListAudioEndpoints(false, endpoints);
+		if (SUCCEEDED(hr))
+		{
+			// read the names through a pool of PARALLEL_PROPERTY_READS slots
+			int count = (int)endpoints->devices.size();
+			std::vector<std::shared_ptr<DeviceProperties>> properties(count);
+			std::vector<HRESULT> results(count, E_FAIL);
+			RunDeadlineCallPool(count, PARALLEL_PROPERTY_READS, [&](int i) -> HDEADLINECALL
+			{
+				properties[i] = std::make_shared<DeviceProperties>();
+				return BeginReadDeviceProperties(endpoints->devices[i], endpoints->ids[i].c_str(), NULL != pFormFactors, properties[i]);
+			},
+			[&results](int i, HRESULT hrRead)
+			{
+				results[i] = hrRead;
+			});
+
+			// collect the reads in enumeration order
+			for (int i = 0; i < count; i++)
+			{
+				const std::wstring& id = endpoints->ids[i];
+				if (SUCCEEDED(results[i]))
+				{
+					deviceIds.push_back(id);
+					deviceNames.push_back(properties[i]->name);
+					if (pFormFactors)
+						pFormFactors->push_back(properties[i]->formFactor);
+				}
+				else if ((E_BACKEND_TIMEOUT == results[i]) || (E_BACKEND_CIRCUIT_OPEN == results[i]))
 				{
-					for (UINT i = 0; i < count; i++)
+					// a slow device isn't a removed one
+					int row = lastEnumeration->activeTable.FindId(id);
+					if (row >= 0)
 					{
-						IMMDevice *pDevice;
-						hr = pDevices->Item(i, &pDevice);
-						if (SUCCEEDED(hr))
-						{
-							LPWSTR wstrID = NULL;
-							hr = pDevice->GetId(&wstrID);
-							if (SUCCEEDED(hr))
-							{
-								IPropertyStore *pStore;
-								hr = pDevice->OpenPropertyStore(STGM_READ, &pStore);
-								if (SUCCEEDED(hr))
-								{
-									PROPVARIANT friendlyName;
-									PropVariantInit(&friendlyName);
-									hr = pStore->GetValue(PKEY_Device_FriendlyName, &friendlyName);
-									if (SUCCEEDED(hr))
-									{
-										// get and store the audio device's friendly string name
-										WCHAR szTitle[MAX_DEVICE_STRING_LENGTH];
-										HRESULT hr = PropVariantToString(friendlyName, szTitle, ARRAYSIZE(szTitle));
-										std::wstring name = szTitle;
-
-										enumeratedDeviceList.push_back(name);
-
-										PropVariantClear(&friendlyName);
-									}
-									pStore->Release();
-								}
-							}
-							pDevice->Release();
-						}
+						deviceIds.push_back(id);
+						deviceNames.push_back(lastEnumeration->activeTable.Name(row));
+						if (pFormFactors)
+							pFormFactors->push_back((ULONG)UnknownFormFactor);
 					}
 				}
-				pDevices->Release();
 			}
-			pEnum->Release();
 		}
+		if (SUCCEEDED(hrInit))
+			CoUninitialize();
+	}
+	return hr;
+}
+
+// EnumerateAudioOutputDevices
+// Enumerate the active audio output devices with each one's friendly name and
+// form factor.  Only first run classifies devices, so only it pays for the
+// extra property read.  See ReadAudioOutputDevices.
+//
+// Parameters:
+//	deviceIds	Set to the encoded device id of each device
+//	deviceNames	Set to the friendly name of each device
+//	formFactors	Set to the EndpointFormFactor of each device
+//
+// Return values:
+//	HRESULT		Indicates success/failure of the enumeration
+HRESULT EnumerateAudioOutputDevices(std::vector<std::wstring>& deviceIds, std::vector<std::wstring>& deviceNames,
+	std::vector<ULONG>& formFactors)
+{
+	return ReadAudioOutputDevices(deviceIds, deviceNames, &formFactors);
+}
+
+// EnumerateAudioOutputDevices
+// Enumerate the active audio output devices and read each one's friendly
+// name.  See ReadAudioOutputDevices.
+//
+// Parameters:
+//	deviceIds	Set to the encoded device id of each device
+//	deviceNames	Set to the friendly name of each device
+//
+// Return values:
+//	HRESULT		Indicates success/failure of the enumeration
+HRESULT EnumerateAudioOutputDevices(std::vector<std::wstring>& deviceIds, std::vector<std::wstring>& deviceNames)
+{
+	return ReadAudioOutputDevices(deviceIds, deviceNames, NULL);
+}
+
+
+// DiscoverAllAudioOutputDevices
+// Enumerate the list of audio devices and store the string names into 
+// the enumeratedDeviceList
+//
+// Parameters:
+//	enumeratedDeviceList	A list of all audio device name strings.  Strings
+//							match the name displayed in audio control panel
+//
+// Return values:
+//	none
+void DiscoverAllAudioOutputDevices(std::vector<std::wstring>& enumeratedDeviceList)
+{
+	std::vector<std::wstring> deviceIds;
+	EnumerateAudioOutputDevices(deviceIds, enumeratedDeviceList);
+}
+
+
+// RefreshDeviceAvailability
+// Enumerates the active output devices and updates the device list's
+// availability bitmap from them.  See ApplyDeviceAvailability.
+//
+// Parameters:
+//	pDiff		Set to what changed since the last enumeration (may be NULL)
+//
+// Return values:
+//	none
+void RefreshDeviceAvailability(DeviceListDiff* pDiff)
+{
+	std::vector<std::wstring> deviceIds;
+	std::vector<std::wstring> deviceNames;
+	HRESULT hr = EnumerateAudioOutputDevices(deviceIds, deviceNames);
+	ApplyDeviceAvailability(hr, deviceIds, deviceNames, pDiff);
+}
+
+// ApplyDeviceAvailability
+// Updates the device list's availability bitmap from an enumeration that was
+// already made - one bit per toggle list entry, set when an active output
+// device matches the entry.  Only the first MAX_TRACKED_TOGGLE_DEVICES
+// entries are tracked.  When devices were only added, just the new names are
+// matched; nothing is published if no device changed.
+//
+// Parameters:
+//	hrEnumerate	Result of the enumeration
+//	deviceIds	Encoded ids the enumeration returned
+//	deviceNames	Friendly names the enumeration returned, same order
+//	pDiff		Set to what changed since the last enumeration (may be NULL)
+//
+// Return values:
+//	none
+void ApplyDeviceAvailability(HRESULT hrEnumerate, const std::vector<std::wstring>& deviceIds,
+	const std::vector<std::wstring>& deviceNames, DeviceListDiff* pDiff)
+{
+	DeviceListDiff diff;
+	if (FAILED(hrEnumerate))
+	{
+		// can't tell - don't lock the user out of any entry
+		UpdateDeviceList([](DeviceListSnapshot& deviceList)
+		{
+			deviceList.availableMask = ~0ULL;
+			deviceList.activeDevicesEnumerated = false;
+			return true;
+		});
+		if (pDiff)
+			*pDiff = diff;
+		return;
 	}
+
+	UpdateDeviceList([&deviceIds, &deviceNames, &diff](DeviceListSnapshot& deviceList)
+	{
+		DiffAudioOutputDevices(deviceList.activeTable, deviceIds, deviceNames, diff);
+		if (deviceList.activeDevicesEnumerated && diff.Empty())
+			return false;
+
+		bool onlyAdded = diff.removedIds.empty() && diff.renamedIds.empty();
+		deviceList.activeTable.Assign(deviceIds, deviceNames);
+
+		if (deviceList.activeDevicesEnumerated && onlyAdded && deviceList.matcher)
+		{
+			// entries can only have become available
+			std::vector<bool> matched(deviceList.SwitchCount(), false);
+			for (unsigned int i = 0; i < diff.addedNames.size(); i++)
+			{
+				deviceList.matcher->Match(diff.addedNames[i], matched);
+			}
+			for (int i = 0; (i < (int)matched.size()) && (i < MAX_TRACKED_TOGGLE_DEVICES); i++)
+			{
+				if (matched[i])
+					deviceList.availableMask |= (1ULL << i);
+			}
+		}
+		else
+		{
+			deviceList.availableMask = MatchActiveDevices(deviceList);
+		}
+		deviceList.activeDevicesEnumerated = true;
+		return true;
+	});
+
+	if (pDiff)
+		*pDiff = diff;
 }
 
 
@@ -116,71 +479,123 @@ void DiscoverAllAudioOutputDevices(std::vector<std::wstring>& enumeratedDeviceLi
 int DiscoverCurrentAudioOutputDevice(int &deviceSwitchListIndex)
 {
 	int ret_value = -1;
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
 
 	// If the list of devices don't include the currently active device, just go with the 
 	// first one by default
 	deviceSwitchListIndex = 0;
 
-	HRESULT hr = CoInitialize(NULL);
-	if (SUCCEEDED(hr))
+	HRESULT hrInit = CoInitialize(NULL);
+	if (SUCCEEDED(hrInit) || (RPC_E_CHANGED_MODE == hrInit))
 	{
-		IMMDeviceEnumerator *pEnum = NULL;
-		// Create a multimedia device enumerator.
-		hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL,
-			CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&pEnum);
-		if (SUCCEEDED(hr))
+		std::shared_ptr<EndpointList> endpoints = std::make_shared<EndpointList>();
+		HRESULT hr = ListAudioEndpoints(true, endpoints);
+		if (SUCCEEDED(hr) && !endpoints->devices.empty())
 		{
-			EDataFlow dataFlow = eRender;
-			ERole role = eMultimedia;
-			IMMDevice* pDefaultAudioEndpoint = nullptr;
-			bool	defaultDeviceFound = false;
-
-			hr = pEnum->GetDefaultAudioEndpoint(dataFlow, role, &pDefaultAudioEndpoint);
-			if (SUCCEEDED(hr) && pDefaultAudioEndpoint)
+			// the last enumeration usually already knows the device's name
+			std::wstring name;
+			int row = deviceList->activeTable.FindId(endpoints->ids[0]);
+			if (row >= 0)
+				name = deviceList->activeTable.Name(row);
+			else
+				hr = ReadDeviceFriendlyName(endpoints->devices[0], endpoints->ids[0].c_str(), name);
+			if (SUCCEEDED(hr) && deviceList->matcher)
 			{
-				defaultDeviceFound = true;
-
-				IPropertyStore *pStore;
-				hr = pDefaultAudioEndpoint->OpenPropertyStore(STGM_READ, &pStore);
-				if (SUCCEEDED(hr))
+				// find the first toggle list entry the current default device matches
+				int index = deviceList->matcher->FirstMatch(name);
+				if (index >= 0)
 				{
-					PROPVARIANT friendlyName;
-					PropVariantInit(&friendlyName);
-					hr = pStore->GetValue(PKEY_Device_FriendlyName, &friendlyName);
-					if (SUCCEEDED(hr))
-					{
-						WCHAR szTitle[1024];
-						HRESULT hr = PropVariantToString(friendlyName, szTitle, ARRAYSIZE(szTitle));
-
-						// search the list of enumerated devices and find the current default one
-						std::wstring name = szTitle;
-
-						unsigned int i = 0;
-						while ((i<g_EnumeratedDeviceListSwitchIndexes.size()) && (0 != ret_value))						
-						{
-							std::size_t found = name.find(g_EnumeratedDeviceList[g_EnumeratedDeviceListSwitchIndexes[i]]);
-							if (found != std::string::npos)
-							{
-								deviceSwitchListIndex = i;
-								ret_value = 0;
-							}
-							i++;
-						}	
-						PropVariantClear(&friendlyName);
-					}
-					pStore->Release();
-				}	
-				pDefaultAudioEndpoint->Release();
+					deviceSwitchListIndex = index;
+					ret_value = 0;
+				}
 			}
-			pEnum->Release();
 		}
+		if (SUCCEEDED(hrInit))
+			CoUninitialize();
 	}
 
 	return ret_value;
 }
 
+// CountActiveAudioSessions
+// Counts the audio sessions currently playing on an endpoint, not counting
+// the system sounds session
+//
+// Parameters:
+//	pDevice		The audio endpoint
+//
+// Return values:
+//	Number of active sessions, or -1 if they could not be enumerated
+static int CountActiveAudioSessions(IMMDevice* pDevice)
+{
+	IAudioSessionManager2* pSessionManager = nullptr;
+	HRESULT hr = pDevice->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, NULL, (void**)&pSessionManager);
+	if (FAILED(hr))
+		return -1;
+
+	int activeCount = -1;
+	IAudioSessionEnumerator* pSessions = nullptr;
+	hr = pSessionManager->GetSessionEnumerator(&pSessions);
+	if (SUCCEEDED(hr))
+	{
+		int count = 0;
+		pSessions->GetCount(&count);
+		activeCount = 0;
+		for (int i = 0; i < count; i++)
+		{
+			IAudioSessionControl* pControl = nullptr;
+			if (FAILED(pSessions->GetSession(i, &pControl)))
+				continue;
+
+			AudioSessionState state = AudioSessionStateInactive;
+			pControl->GetState(&state);
+
+			IAudioSessionControl2* pControl2 = nullptr;
+			bool systemSounds = false;
+			if (SUCCEEDED(pControl->QueryInterface(__uuidof(IAudioSessionControl2), (void**)&pControl2)))
+			{
+				systemSounds = (S_OK == pControl2->IsSystemSoundsSession());
+				pControl2->Release();
+			}
+
+			if ((AudioSessionStateActive == state) && !systemSounds)
+				activeCount++;
+			pControl->Release();
+		}
+		pSessions->Release();
+	}
+	pSessionManager->Release();
+	return activeCount;
+}
+
+// the default device roles a switch moves, in the order they are set
+struct SwitchStep
+{
+	ERole role;
+	LPCWSTR operation;		// name of the step in the trace log
+};
+
+static const SwitchStep g_SwitchSteps[] =
+{
+	{ eConsole,			L"SetDefaultEndpoint" },
+	{ eMultimedia,		L"SetDefaultEndpointMultimedia" },
+	{ eCommunications,	L"SetDefaultEndpointCommunications" }
+};
+
 // SetAudioPlaybackDevice
-// Set the audio playback device to the one defined by the encoded devID string
+// Set the audio playback device to the one defined by the encoded devID string.
+// Like the control panel's Set Default this moves the console and multimedia
+// defaults together, so apps with streams already open that follow them move
+// to the new device instead of playing on the old one until they restart.
+// The communications default (ie: a headset kept for calls) is only moved 
+// too if /movecommunications was given.  With /trace an estimate of the 
+// number of streams that moved off the old device is logged.
+//
+// The roles are set as one transaction: the current default of each role is
+// read first, roles already on the device are skipped, and if setting any 
+// role fails the roles set before it are put back so the system isn't left
+// half switched.  The call runs under the backend watchdog; a switch that 
+// is abandoned there can't be rolled back.
 //
 // Parameters:
 //	devID		The encoded device ID string of the audio device to set
@@ -190,106 +605,449 @@ int DiscoverCurrentAudioOutputDevice(int &deviceSwitchListIndex)
 //	HRESULT		Indicates success/failure of set operation
 HRESULT SetAudioPlaybackDevice(LPCWSTR devID)
 {
-	IPolicyConfigVista *pPolicyConfig;
-	ERole reserved = eConsole;
+	std::wstring deviceId = devID;
+	bool migrateCommunications = g_MigrateCommunicationsRole;
 
-	HRESULT hr = CoCreateInstance(__uuidof(CPolicyConfigVistaClient), NULL, CLSCTX_ALL, __uuidof(IPolicyConfigVista), (LPVOID *)&pPolicyConfig);
-	if (SUCCEEDED(hr))
+	// the worker looks the enumerator up in its own apartment; only the
+	// creation, which can block on the audio service, happens out here
+	CreateAudioDeviceEnumerator();
+
+	return RunWithDeadline(L"SetAudioPlaybackDevice", devID, [deviceId, migrateCommunications]() -> HRESULT
+	{
+		IMMDeviceEnumerator* pEnumerator = nullptr;
+		GetAudioDeviceEnumerator(&pEnumerator);
+		std::shared_ptr<IMMDeviceEnumerator> enumerator(pEnumerator, [](IMMDeviceEnumerator* p) { if (p) p->Release(); });
+
+		const int stepCount = migrateCommunications ? ARRAYSIZE(g_SwitchSteps) : ARRAYSIZE(g_SwitchSteps) - 1;
+		LONGLONG transactionStartTime = BackendTraceTimestamp();
+
+		// remember each role's current default so it can be put back
+		std::wstring previousIds[ARRAYSIZE(g_SwitchSteps)];
+		IMMDevice* pOldDevice = nullptr;
+		if (enumerator)
+		{
+			for (int i = 0; i < stepCount; i++)
+			{
+				IMMDevice* pDefault = nullptr;
+				LONGLONG startTime = BackendTraceTimestamp();
+				HRESULT hr = enumerator->GetDefaultAudioEndpoint(eRender, g_SwitchSteps[i].role, &pDefault);
+				if (SUCCEEDED(hr))
+				{
+					LPWSTR wstrID = NULL;
+					if (SUCCEEDED(pDefault->GetId(&wstrID)))
+					{
+						previousIds[i] = wstrID;
+						CoTaskMemFree(wstrID);
+					}
+
+					// the console device is the one whose streams are moved
+					if (eConsole == g_SwitchSteps[i].role)
+						pOldDevice = pDefault;
+					else
+						pDefault->Release();
+				}
+				TraceBackendCall(L"GetDefaultAudioEndpoint", startTime, hr, previousIds[i].c_str());
+			}
+		}
+
+		// only look at the old device's streams when someone will read the count
+		int sessionsBefore = (pOldDevice && IsBackendTraceEnabled()) ? CountActiveAudioSessions(pOldDevice) : -1;
+
+		IPolicyConfigVista *pPolicyConfig;
+		LONGLONG startTime = BackendTraceTimestamp();
+		HRESULT hr = CoCreateInstance(__uuidof(CPolicyConfigVistaClient), NULL, CLSCTX_ALL, __uuidof(IPolicyConfigVista), (LPVOID *)&pPolicyConfig);
+		TraceBackendCall(L"CreatePolicyConfig", startTime, hr, NULL);
+		if (SUCCEEDED(hr))
+		{
+			// apply the steps, stopping at the first one that fails.  Roles
+			// already on the device are skipped.
+			int step = 0;
+			int applied = 0;
+			int skipped = 0;
+			bool stepApplied[ARRAYSIZE(g_SwitchSteps)] = {};
+			for (; (step < stepCount) && SUCCEEDED(hr); step++)
+			{
+				if (previousIds[step] == deviceId)
+				{
+					skipped++;
+					continue;
+				}
+
+				startTime = BackendTraceTimestamp();
+				hr = pPolicyConfig->SetDefaultEndpoint(deviceId.c_str(), g_SwitchSteps[step].role);
+				TraceBackendCall(g_SwitchSteps[step].operation, startTime, hr, deviceId.c_str());
+				stepApplied[step] = SUCCEEDED(hr);
+				if (stepApplied[step])
+					applied++;
+			}
+
+			// put back whatever was changed, newest first
+			int rolledBack = 0;
+			if (FAILED(hr))
+			{
+				for (int i = step - 1; i >= 0; i--)
+				{
+					if (!stepApplied[i] || previousIds[i].empty())
+						continue;
+
+					startTime = BackendTraceTimestamp();
+					HRESULT hrRollback = pPolicyConfig->SetDefaultEndpoint(previousIds[i].c_str(), g_SwitchSteps[i].role);
+					TraceBackendCall(L"RollbackDefaultEndpoint", startTime, hrRollback, previousIds[i].c_str());
+					rolledBack++;
+				}
+			}
+			else if (pOldDevice && (sessionsBefore >= 0))
+			{
+				// streams move over on their own - count what's left once they've had a moment
+				pOldDevice->AddRef();
+				std::shared_ptr<IMMDevice> oldDevice(pOldDevice, [](IMMDevice* p) { p->Release(); });
+				// the count is only an estimate: a stream that stopped or 
+				// started in the meantime looks like one that moved or stayed.
+				// The line's elapsed time is the count itself; the settle delay 
+				// it waited out is logged on its own.
+				QueueBackgroundTask(TASK_PRIORITY_LOW, L"StreamMigration", STREAM_MIGRATION_SETTLE_MS, [oldDevice, sessionsBefore]()
+				{
+					LONGLONG countStartTime = BackendTraceTimestamp();
+					int sessionsLeft = CountActiveAudioSessions(oldDevice.get());
+					WCHAR summary[128];
+					swprintf_s(summary, L"sessions=%d approx_moved=%d left=%d settle_ms=%d", sessionsBefore,
+						(sessionsLeft >= 0) ? sessionsBefore - sessionsLeft : 0, sessionsLeft, STREAM_MIGRATION_SETTLE_MS);
+					TraceBackendCall(L"StreamMigration", countStartTime, (sessionsLeft >= 0) ? S_OK : E_FAIL, summary);
+				});
+			}
+
+			WCHAR summary[128];
+			swprintf_s(summary, L"steps=%d applied=%d skipped=%d rolled_back=%d", stepCount, applied, skipped, rolledBack);
+			TraceBackendCall(L"SwitchTransaction", transactionStartTime, hr, summary);
+			pPolicyConfig->Release();
+		}
+
+		if (pOldDevice)
+			pOldDevice->Release();
+		return hr;
+	});
+}
+
+// ResolveAudioOutputDeviceId
+// Finds the encoded device id of the toggle list entry at deviceSwitchListIndex
+// by enumerating the active output devices and matching their friendly names
+// against the entry
+//
+// Parameters:
+//	deviceSwitchListIndex	The index in the device list's switch
+//				list to resolve
+//	deviceId	Set to the encoded device id of the matching device
+//
+// Return values:
+//	0		A matching device was found
+//	-1		No active device matches the entry
+int ResolveAudioOutputDeviceId(const int deviceSwitchListIndex, std::wstring& deviceId)
+{
+	int result = -1;
+
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if ((deviceSwitchListIndex < 0) || (deviceSwitchListIndex >= deviceList->SwitchCount()))
+		return -1;
+	if (!deviceList->matcher)
+		return -1;
+
+	std::vector<std::wstring> deviceIds;
+	std::vector<std::wstring> deviceNames;
+	EnumerateAudioOutputDevices(deviceIds, deviceNames);
+
+	// is this the right device?
+	for (unsigned int i = 0; (i < deviceNames.size()) && (0 != result); i++)
 	{
-		hr = pPolicyConfig->SetDefaultEndpoint(devID, reserved);
-		pPolicyConfig->Release();
+		if (deviceList->matcher->Matches(deviceNames[i], deviceSwitchListIndex))
+		{
+			deviceId = deviceIds[i];
+			result = 0;
+		}
 	}
-	return hr;
+	return result;
+}
+
+// ResolveFromLastEnumeration
+// Finds the encoded device id of a toggle list entry among the devices the
+// last availability enumeration found, without calling the backend
+//
+// Parameters:
+//	deviceList		Snapshot holding the last enumeration
+//	deviceSwitchListIndex	The index in the device list's switch
+//				list to resolve
+//	deviceId	Set to the encoded device id of the matching device
+//
+// Return values:
+//	0		A matching device was found
+//	-1		No enumerated device matches the entry, or there is no enumeration
+static int ResolveFromLastEnumeration(const DeviceListSnapshot& deviceList, const int deviceSwitchListIndex, std::wstring& deviceId)
+{
+	if (!deviceList.activeDevicesEnumerated || !deviceList.matcher)
+		return -1;
+
+	std::wstring name;
+	for (int i = 0; i < deviceList.activeTable.Count(); i++)
+	{
+		name.assign(deviceList.activeTable.Name(i));
+		if (deviceList.matcher->Matches(name, deviceSwitchListIndex))
+		{
+			deviceId = deviceList.activeTable.Id(i);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// PrefetchAudioOutputDevice
+// Starts resolving the endpoint id of the toggle list entry that the next
+// double-click will switch to, so the switch itself only has to issue the
+// set-default call.  Also keeps one policy config object alive so its COM
+// server stays loaded between switches.  Called from the message loop after
+// each switch; the resolve itself runs on a background worker, which posts
+// WM_APP_PREFETCH_RESOLVED_EVENT when it is done.
+//
+// Parameters:
+//	deviceSwitchListIndex	The index in the device list's switch
+//				list to prefetch
+//
+// Return values:
+//	none
+void PrefetchAudioOutputDevice(const int deviceSwitchListIndex)
+{
+	InvalidateAudioOutputDevicePrefetch();
+	if (deviceSwitchListIndex >= AcquireDeviceList()->SwitchCount())
+		return;
+
+	if (!g_pWarmPolicyConfig)
+	{
+		CoCreateInstance(__uuidof(CPolicyConfigVistaClient), NULL, CLSCTX_ALL, __uuidof(IPolicyConfigVista), (LPVOID *)&g_pWarmPolicyConfig);
+	}
+
+	UINT generation = g_PrefetchGeneration;
+	HWND hWnd = g_hWnd;
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Prefetch", 0, [generation, deviceSwitchListIndex, hWnd]()
+	{
+		LONGLONG startTime = BackendTraceTimestamp();
+		std::wstring deviceId;
+		int index = (0 == ResolveAudioOutputDeviceId(deviceSwitchListIndex, deviceId)) ? deviceSwitchListIndex : -1;
+		{
+			std::lock_guard<std::mutex> lock(g_PrefetchResultLock);
+			g_PrefetchResult.generation = generation;
+			g_PrefetchResult.index = index;
+			g_PrefetchResult.deviceId = deviceId;
+			g_PrefetchResult.startTime = startTime;
+		}
+		PostMessage(hWnd, WM_APP_PREFETCH_RESOLVED_EVENT, (WPARAM)generation, 0);
+	});
+}
+
+// OnAudioOutputDevicePrefetched
+// Takes the result of a background prefetch resolve on the UI thread.  The
+// result is dropped if the prefetch was invalidated while it ran.
+//
+// Parameters:
+//	generation	The generation the resolve was started under
+//
+// Return values:
+//	none
+void OnAudioOutputDevicePrefetched(UINT generation)
+{
+	std::lock_guard<std::mutex> lock(g_PrefetchResultLock);
+	if ((generation != g_PrefetchGeneration) || (generation != g_PrefetchResult.generation))
+		return;
+
+	if (-1 != g_PrefetchResult.index)
+	{
+		g_PrefetchedIndex = g_PrefetchResult.index;
+		g_PrefetchedDeviceId = g_PrefetchResult.deviceId;
+	}
+	// the elapsed time here is what a prefetch hit saves the next click
+	TraceBackendCall(L"PrefetchResolve", g_PrefetchResult.startTime, (-1 == g_PrefetchedIndex) ? E_FAIL : S_OK, g_PrefetchedDeviceId.c_str());
+}
+
+// InvalidateAudioOutputDevicePrefetch
+// Forgets the prefetched endpoint and cancels a resolve still in progress -
+// needed whenever the toggle list changes or a switch starts
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void InvalidateAudioOutputDevicePrefetch()
+{
+	g_PrefetchedIndex = -1;
+	g_PrefetchedDeviceId.clear();
+	g_PrefetchGeneration++;
+	CancelBackgroundTask(L"Prefetch");
+}
+
+// InvalidateAudioOutputDevicePrefetch
+// Forgets the prefetched endpoint only if a device change affected it
+//
+// Parameters:
+//	diff	What changed since the last enumeration
+//
+// Return values:
+//	true	The prefetch was dropped and should be redone
+//	false	The prefetched endpoint is still good
+bool InvalidateAudioOutputDevicePrefetch(const DeviceListDiff& diff)
+{
+	if (-1 == g_PrefetchedIndex)
+		return true;
+
+	bool affected = false;
+	for (unsigned int i = 0; (i < diff.removedIds.size()) && !affected; i++)
+	{
+		affected = (diff.removedIds[i] == g_PrefetchedDeviceId);
+	}
+	for (unsigned int i = 0; (i < diff.renamedIds.size()) && !affected; i++)
+	{
+		affected = (diff.renamedIds[i] == g_PrefetchedDeviceId);
+	}
+
+	if (affected)
+		InvalidateAudioOutputDevicePrefetch();
+	return affected;
+}
+
+// ReleaseWarmAudioObjects
+// Drops the prefetched endpoint and the warm policy config object.  The next
+// prefetch creates them again.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void ReleaseWarmAudioObjects()
+{
+	InvalidateAudioOutputDevicePrefetch();
+	if (g_pWarmPolicyConfig)
+	{
+		g_pWarmPolicyConfig->Release();
+		g_pWarmPolicyConfig = nullptr;
+	}
+}
+
+// ReleaseAudioOutputDevicePrefetch
+// Drops the prefetch state and the warm policy config object on exit and
+// writes the prefetch hit rate to the trace log
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void ReleaseAudioOutputDevicePrefetch()
+{
+	ReleaseWarmAudioObjects();
+
+	WCHAR summary[128];
+	swprintf_s(summary, L"hits=%u misses=%u", g_PrefetchHits, g_PrefetchMisses);
+	TraceBackendCall(L"PrefetchSummary", BackendTraceTimestamp(), S_OK, summary);
 }
 
 // SetActiveAudioOutputDevice
-// This sets the audio playback device to the one selected to by deviceSwitchListIndex
+// This sets the audio playback device to the one selected to by deviceSwitchListIndex.
+// Uses the prefetched endpoint id when it matches, or else the devices the
+// last availability enumeration found, and only enumerates again if that id
+// turns out to be stale.  Schedules the prefetch of the following entry once
+// the switch is done.  All of the switch's backend calls together get
+// SWITCH_BACKEND_BUDGET_MS, and a switch asked for while one is already in
+// progress fails.
 //
 // Parameters:
-//	deviceSwitchListIndex	The index in g_EnumeratedDeviceListSwitchIndexes switch
+//	deviceSwitchListIndex	The index in the device list's switch
 //				list that should be set as the current audio output device.
+//	recordTiming	true if this is a switch the user asked for, whose phases
+//				belong in the switch timing summary
 //
 // Return values:
 //	0		The desired audio device was set correctly
-//	-1		The desired audio device set operation failed
-int SetActiveAudioOutputDevice(const int deviceSwitchListIndex)
+//	-1		The desired audio device set operation failed or timed out
+int SetActiveAudioOutputDevice(const int deviceSwitchListIndex, bool recordTiming)
 {
 	int result = -1;
-	std::wstring defaultDeviceString;
-	
-	HRESULT hr = CoInitialize(NULL);
-	if (SUCCEEDED(hr))
+	LONGLONG startTime = BackendTraceTimestamp();
+
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if ((deviceSwitchListIndex < 0) || (deviceSwitchListIndex >= deviceList->SwitchCount()))
+		return -1;
+	std::wstring deviceName = deviceList->SwitchName(deviceSwitchListIndex);
+	if (g_SwitchInProgress)
 	{
-		IMMDeviceEnumerator *pEnum = NULL;
-		// Create a multimedia device enumerator.
-		hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL,
-			CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&pEnum);
-		if (SUCCEEDED(hr))
-		{
-			IMMDeviceCollection *pDevices;
+		TraceBackendCall(L"SwitchBusy", startTime, E_FAIL, deviceName.c_str());
+		return -1;
+	}
+	g_SwitchInProgress = true;
+	BeginBackendBudget(SWITCH_BACKEND_BUDGET_MS);
 
-			// Enumerate the output devices.
-			hr = pEnum->EnumAudioEndpoints(eRender, DEVICE_STATE_ACTIVE, &pDevices);
-			if (SUCCEEDED(hr))
+	// use the prefetched endpoint if it is the one we want.  A resolve still
+	// in progress is of no use to this switch.  Only switches the user asked
+	// for count towards the hit rate - switches the app makes itself (startup,
+	// failover, the dialog) go wherever they need to and would skew it.
+	std::wstring deviceId;
+	bool prefetchHit = (deviceSwitchListIndex == g_PrefetchedIndex);
+	if (!prefetchHit)
+		InvalidateAudioOutputDevicePrefetch();
+	if (prefetchHit)
+		deviceId = g_PrefetchedDeviceId;
+	if (recordTiming)
+	{
+		if (prefetchHit)
+			g_PrefetchHits++;
+		else
+			g_PrefetchMisses++;
+	}
+
+	LONGLONG phaseStart = BackendTraceTimestamp();
+	bool freshResolve = false;
+	bool resolved = prefetchHit || (0 == ResolveFromLastEnumeration(*deviceList, deviceSwitchListIndex, deviceId));
+	if (!resolved)
+	{
+		freshResolve = true;
+		resolved = (0 == ResolveAudioOutputDeviceId(deviceSwitchListIndex, deviceId));
+	}
+	if (recordTiming)
+		RecordSwitchPhase(SWITCH_PHASE_RESOLVE, phaseStart);
+
+	if (resolved)
+	{
+		// set the playback device - deviceId is an encoded device id
+		phaseStart = BackendTraceTimestamp();
+		HRESULT setResult = SetAudioPlaybackDevice(deviceId.c_str());
+
+		// the device may have gone away since - resolve it again
+		if (!freshResolve && FAILED(setResult) && (E_BACKEND_TIMEOUT != setResult) && (E_BACKEND_CIRCUIT_OPEN != setResult))
+		{
+			if (0 == ResolveAudioOutputDeviceId(deviceSwitchListIndex, deviceId))
 			{
-				UINT count;
-				hr = pDevices->GetCount(&count);
-				if (SUCCEEDED(hr))
-				{
-					for (UINT i = 0; i < count; i++)
-					{
-						IMMDevice *pDevice;
-						hr = pDevices->Item(i, &pDevice);
-						if (SUCCEEDED(hr))
-						{
-							LPWSTR wstrID = NULL;
-							hr = pDevice->GetId(&wstrID);
-							if (SUCCEEDED(hr))
-							{
-								IPropertyStore *pStore;
-								hr = pDevice->OpenPropertyStore(STGM_READ, &pStore);
-								if (SUCCEEDED(hr))
-								{
-									PROPVARIANT friendlyName;
-									PropVariantInit(&friendlyName);
-									hr = pStore->GetValue(PKEY_Device_FriendlyName, &friendlyName);
-									if (SUCCEEDED(hr))
-									{
-										// search for the desired one
-										assert(deviceSwitchListIndex < (int) g_EnumeratedDeviceListSwitchIndexes.size());
-										std::wstring NameToFind = g_EnumeratedDeviceList[g_EnumeratedDeviceListSwitchIndexes[deviceSwitchListIndex]];
-
-										// get the friendly name of the next enumerated device
-										WCHAR szTitle[MAX_DEVICE_STRING_LENGTH];
-										HRESULT hr = PropVariantToString(friendlyName, szTitle, ARRAYSIZE(szTitle));
-
-										// convert friendly name to lower
-										std::wstring friendly_device_name = szTitle;
-
-										// is this the right device?
-										if (std::string::npos != friendly_device_name.find(NameToFind))
-										{
-											// set the playback device - wstrID is an encoded device id
-											SetAudioPlaybackDevice(wstrID);
-
-											// cleanup and exit
-											PropVariantClear(&friendlyName);
-											result = 0;
-										}
-										// release the prop
-										PropVariantClear(&friendlyName);
-									}
-									pStore->Release();
-								}
-							}
-							pDevice->Release();
-						}
-					}
-				}
-				pDevices->Release();
+				setResult = SetAudioPlaybackDevice(deviceId.c_str());
 			}
-			pEnum->Release();
+		}
+		if (recordTiming)
+			RecordSwitchPhase(SWITCH_PHASE_SET_DEFAULT, phaseStart);
+
+		if (SUCCEEDED(setResult))
+		{
+			result = 0;
+		}
+		else if ((E_BACKEND_TIMEOUT == setResult) || (E_BACKEND_CIRCUIT_OPEN == setResult))
+		{
+			// let the user know why the switch didn't happen
+			std::wstring notice = deviceName + L" is not responding.";
+			ShowTrayNotice(L"Audio device not responding", notice.c_str());
 		}
 	}
+	EndBackendBudget();
+	g_SwitchInProgress = false;
+	TraceBackendCall(prefetchHit ? L"SwitchPrefetchHit" : L"SwitchPrefetchMiss", startTime, (0 == result) ? S_OK : E_FAIL, deviceName.c_str());
+	TraceResourceUsage(L"Switch");
+
+	// get the next toggle target ready once the message queue is idle
+	InvalidateAudioOutputDevicePrefetch();
+	PostMessage(g_hWnd, WM_APP_PREFETCH_EVENT, 0, 0);
+
 	return result;
 }
@@ -8,8 +8,51 @@
 #include "stdafx.h"
 #include <assert.h>
 
+#include "Mmdeviceapi.h"
+#include "devicelist.h"
+#include "deviceenumerator.h"
+#include "deviceavailability.h"
+
+// number of endpoint property reads allowed in flight at once while enumerating
+#define PARALLEL_PROPERTY_READS		4
+
+// how long after a switch the streams left on the old device are counted
+#define STREAM_MIGRATION_SETTLE_MS	1000
+
+// DeviceProperties
+// What one property store read returns for an endpoint
+struct DeviceProperties
+{
+	std::wstring name;		// friendly name, as shown in the audio control panel
+	ULONG formFactor;		// EndpointFormFactor, UnknownFormFactor if it couldn't be read
+
+	DeviceProperties() : formFactor((ULONG)UnknownFormFactor)
+	{
+	}
+};
+
+// true if /movecommunications was given
+extern bool g_MigrateCommunicationsRole;
+
 // Routines used to enumrate and set current audio device
+HRESULT EnumerateAudioOutputDevices(std::vector<std::wstring>& deviceIds, std::vector<std::wstring>& deviceNames,
+	std::vector<ULONG>& formFactors);
+HRESULT EnumerateAudioOutputDevices(std::vector<std::wstring>& deviceIds, std::vector<std::wstring>& deviceNames);
 void DiscoverAllAudioOutputDevices(std::vector<std::wstring>& enumeratedDeviceList);
 int DiscoverCurrentAudioOutputDevice(int &deviceSwitchListIndex);
 HRESULT SetAudioPlaybackDevice(LPCWSTR devID);
-int SetActiveAudioOutputDevice(const int deviceSwitchListIndex);
\ No newline at end of file
+int ResolveAudioOutputDeviceId(const int deviceSwitchListIndex, std::wstring& deviceId);
+int SetActiveAudioOutputDevice(const int deviceSwitchListIndex, bool recordTiming);
+
+// Routines used to enumerate which toggle list entries are plugged in
+void RefreshDeviceAvailability(DeviceListDiff* pDiff);
+void ApplyDeviceAvailability(HRESULT hrEnumerate, const std::vector<std::wstring>& deviceIds,
+	const std::vector<std::wstring>& deviceNames, DeviceListDiff* pDiff);
+
+// Routines used to prefetch the next device to toggle to
+void PrefetchAudioOutputDevice(const int deviceSwitchListIndex);
+void OnAudioOutputDevicePrefetched(UINT generation);
+void InvalidateAudioOutputDevicePrefetch();
+bool InvalidateAudioOutputDevicePrefetch(const DeviceListDiff& diff);
+void ReleaseWarmAudioObjects();
+void ReleaseAudioOutputDevicePrefetch();
@@ -0,0 +1,133 @@
+// ----------------------------------------------------------------------------
+// deviceenumerator.cpp
+// The one audio device enumerator shared by every backend call
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "deviceenumerator.h"
+#include "backendtrace.h"
+#include "backendwatchdog.h"
+
+#include <memory>
+#include <mutex>
+
+// the one device enumerator every backend call goes through.  It is created
+// in the multithreaded apartment of a watchdog worker and parked in the
+// global interface table, so every thread - the STA UI thread included - gets
+// a pointer that is valid in its own apartment instead of sharing the raw one.
+static IGlobalInterfaceTable*	g_pGlobalInterfaceTable = nullptr;
+static DWORD					g_DeviceEnumeratorCookie = 0;
+static std::mutex				g_DeviceEnumeratorLock;
+
+
+// CreateAudioDeviceEnumerator
+// Creates the app's device enumerator if it doesn't exist yet.  Creating an
+// enumerator loads and connects to the audio service, so one is kept for the
+// life of the app instead of paying for that on every switch.  The creation
+// runs under the backend watchdog since it can block on a stuck service.
+// Callers that go on to use the enumerator inside a watchdog worker call this
+// first, on their own thread, so the worker only has to look it up.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	HRESULT		Indicates success/failure of creating the enumerator
+HRESULT CreateAudioDeviceEnumerator()
+{
+	std::lock_guard<std::mutex> lock(g_DeviceEnumeratorLock);
+	if (g_DeviceEnumeratorCookie)
+		return S_OK;
+
+	// an abandoned creation revokes whatever it finally registers
+	struct Created
+	{
+		IGlobalInterfaceTable*	pTable;
+		DWORD					cookie;
+	};
+	std::shared_ptr<Created> created(new Created(), [](Created* p)
+	{
+		if (p->cookie)
+			p->pTable->RevokeInterfaceFromGlobal(p->cookie);
+		if (p->pTable)
+			p->pTable->Release();
+		delete p;
+	});
+
+	HRESULT hr = RunWithDeadline(L"CreateDeviceEnumerator", NULL, [created]() -> HRESULT
+	{
+		HRESULT hr = CoCreateInstance(CLSID_StdGlobalInterfaceTable, NULL, CLSCTX_INPROC_SERVER,
+			IID_IGlobalInterfaceTable, (void**)&created->pTable);
+		if (FAILED(hr))
+			return hr;
+
+		IMMDeviceEnumerator* pEnumerator = nullptr;
+		LONGLONG startTime = BackendTraceTimestamp();
+		hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL,
+			CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&pEnumerator);
+		TraceBackendCall(L"CreateDeviceEnumerator", startTime, hr, NULL);
+		if (SUCCEEDED(hr))
+		{
+			// the table holds its own reference
+			hr = created->pTable->RegisterInterfaceInGlobal(pEnumerator, __uuidof(IMMDeviceEnumerator), &created->cookie);
+			pEnumerator->Release();
+		}
+		return hr;
+	});
+	if (FAILED(hr))
+		return hr;
+
+	g_pGlobalInterfaceTable = created->pTable;
+	g_DeviceEnumeratorCookie = created->cookie;
+	created->pTable = nullptr;
+	created->cookie = 0;
+	return S_OK;
+}
+
+// GetAudioDeviceEnumerator
+// Returns the app's device enumerator for use on the calling thread, creating
+// it on first use.  The pointer is only good in the caller's apartment: a
+// watchdog worker must call this itself rather than be handed the caller's.
+//
+// Parameters:
+//	ppEnum		Set to the enumerator with a reference added for the caller
+//
+// Return values:
+//	HRESULT		Indicates success/failure of getting the enumerator
+HRESULT GetAudioDeviceEnumerator(IMMDeviceEnumerator** ppEnum)
+{
+	*ppEnum = nullptr;
+	HRESULT hr = CreateAudioDeviceEnumerator();
+	if (FAILED(hr))
+		return hr;
+
+	std::lock_guard<std::mutex> lock(g_DeviceEnumeratorLock);
+	if (!g_DeviceEnumeratorCookie)
+		return E_UNEXPECTED;
+	return g_pGlobalInterfaceTable->GetInterfaceFromGlobal(g_DeviceEnumeratorCookie,
+		__uuidof(IMMDeviceEnumerator), (void**)ppEnum);
+}
+
+// ReleaseAudioDeviceEnumerator
+// Drops the app's device enumerator on exit
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void ReleaseAudioDeviceEnumerator()
+{
+	std::lock_guard<std::mutex> lock(g_DeviceEnumeratorLock);
+	if (g_DeviceEnumeratorCookie)
+	{
+		g_pGlobalInterfaceTable->RevokeInterfaceFromGlobal(g_DeviceEnumeratorCookie);
+		g_DeviceEnumeratorCookie = 0;
+	}
+	if (g_pGlobalInterfaceTable)
+	{
+		g_pGlobalInterfaceTable->Release();
+		g_pGlobalInterfaceTable = nullptr;
+	}
+}
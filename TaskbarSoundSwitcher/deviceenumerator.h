@@ -0,0 +1,15 @@
+// ----------------------------------------------------------------------------
+// deviceenumerator.h
+// The one audio device enumerator shared by every backend call
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+#include "Mmdeviceapi.h"
+
+// Routines used to get and drop the app's device enumerator
+HRESULT CreateAudioDeviceEnumerator();
+HRESULT GetAudioDeviceEnumerator(IMMDeviceEnumerator** ppEnum);
+void ReleaseAudioDeviceEnumerator();
@@ -0,0 +1,196 @@
+// ----------------------------------------------------------------------------
+// devicelist.cpp
+// Immutable snapshots of the toggle list that can be read from any thread
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "devicelist.h"
+#include "statuspublisher.h"
+#include "statusblock.h"
+
+#include <algorithm>		// std::transform
+#include <atomic>
+#include <mutex>
+
+// the current snapshot - only ever accessed through std::atomic_load/store
+static DeviceListSnapshotPtr g_pDeviceList = std::make_shared<const DeviceListSnapshot>();
+
+// serializes writers so two updates can't both start from the same snapshot
+static std::mutex g_DeviceListWriteLock;
+
+
+// GetDeviceIconClass
+// Figure out whether a device looks like headphones or speakers based on some
+// name heuristics
+//
+// Parameters:
+//	deviceName	The device's friendly name
+//
+// Return values:
+//	DEVICE_ICON_HEADPHONES	The name mentions headphones or a headset
+//	DEVICE_ICON_SPEAKERS	Anything else
+int GetDeviceIconClass(const std::wstring& deviceName)
+{
+	std::wstring lowerName = deviceName;
+	std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+	if ((std::string::npos != lowerName.find(L"headphone")) || (std::string::npos != lowerName.find(L"headset")))
+	{
+		return DEVICE_ICON_HEADPHONES;
+	}
+	return DEVICE_ICON_SPEAKERS;
+}
+
+// DeviceTable::Append
+// Adds a row to the end of the table
+//
+// Parameters:
+//	name	The row's name
+//	id		The row's encoded device id (empty for toggle list entries)
+//
+// Return values:
+//	none
+void DeviceTable::Append(const std::wstring& name, const std::wstring& id)
+{
+	nameOffsets.push_back((unsigned int)names.size());
+	names.append(name.c_str(), name.size() + 1);
+	idOffsets.push_back((unsigned int)ids.size());
+	ids.append(id.c_str(), id.size() + 1);
+	iconClasses.push_back((unsigned char)GetDeviceIconClass(name));
+}
+
+// DeviceTable::Assign
+// Replaces every row with the devices of an enumeration
+//
+// Parameters:
+//	deviceIds	Encoded device id of each device
+//	deviceNames	Friendly name of each device, same order
+//
+// Return values:
+//	none
+void DeviceTable::Assign(const std::vector<std::wstring>& deviceIds, const std::vector<std::wstring>& deviceNames)
+{
+	*this = DeviceTable();
+	nameOffsets.reserve(deviceNames.size());
+	idOffsets.reserve(deviceIds.size());
+	iconClasses.reserve(deviceNames.size());
+	for (size_t i = 0; i < deviceNames.size(); i++)
+	{
+		Append(deviceNames[i], deviceIds[i]);
+	}
+}
+
+// DeviceTable::FindId
+// Finds the row of a device by its encoded id
+//
+// Parameters:
+//	id		The encoded device id
+//
+// Return values:
+//	The row's index, -1 if no row has the id
+int DeviceTable::FindId(const std::wstring& id) const
+{
+	for (int i = 0; i < Count(); i++)
+	{
+		if (0 == wcscmp(Id(i), id.c_str()))
+			return i;
+	}
+	return -1;
+}
+
+// AcquireDeviceList
+// Returns the current device list.  Never blocks; the snapshot stays valid
+// for as long as the caller holds on to it, even if a new one is published.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	The current snapshot (never NULL)
+DeviceListSnapshotPtr AcquireDeviceList()
+{
+	return std::atomic_load(&g_pDeviceList);
+}
+
+// CompileToggleList
+// Compiles a new snapshot's toggle list entries into its matcher.  Only needed
+// before publishing if the matcher is used first.
+//
+// Parameters:
+//	snapshot	The new device list, not published yet
+//
+// Return values:
+//	none
+void CompileToggleList(DeviceListSnapshot& snapshot)
+{
+	std::vector<std::wstring> entries;
+	for (int i = 0; i < snapshot.SwitchCount(); i++)
+	{
+		entries.push_back(snapshot.SwitchName(i));
+	}
+	snapshot.matcher = std::make_shared<const ToggleMatcher>(entries);
+}
+
+// PublishDeviceList
+// Replaces the current device list with a completely new one (ie: one read
+// from the config file), compiling its toggle list if that wasn't done yet.
+// Every published list is also copied to the shared memory status block.
+//
+// Parameters:
+//	snapshot	The new device list
+//
+// Return values:
+//	none
+void PublishDeviceList(const std::shared_ptr<DeviceListSnapshot>& snapshot)
+{
+	if (!snapshot->matcher)
+		CompileToggleList(*snapshot);
+
+	std::lock_guard<std::mutex> lock(g_DeviceListWriteLock);
+	std::atomic_store(&g_pDeviceList, DeviceListSnapshotPtr(snapshot));
+	PublishStatusBlock(*snapshot);
+}
+
+// UpdateDeviceList
+// Copies the current device list, lets update change the copy and publishes
+// it.  update runs with other writers held off, so it must not make backend
+// calls - gather anything slow first and only apply it here.
+//
+// Parameters:
+//	update		Changes the copy of the current snapshot.  Returns false if
+//				nothing changed, in which case the copy is thrown away.
+//
+// Return values:
+//	The current snapshot - the new one if update changed anything
+DeviceListSnapshotPtr UpdateDeviceList(const std::function<bool(DeviceListSnapshot&)>& update)
+{
+	std::lock_guard<std::mutex> lock(g_DeviceListWriteLock);
+
+	DeviceListSnapshotPtr current = std::atomic_load(&g_pDeviceList);
+	std::shared_ptr<DeviceListSnapshot> next = std::make_shared<DeviceListSnapshot>(*current);
+	if (!update(*next))
+		return current;
+
+	DeviceListSnapshotPtr published = next;
+	std::atomic_store(&g_pDeviceList, published);
+	PublishStatusBlock(*published);
+	return published;
+}
+
+// SetCurrentSwitchIndex
+// Publishes a new snapshot with a different current output device
+//
+// Parameters:
+//	deviceSwitchListIndex	The index in the switch list of the current
+//							audio output device
+//
+// Return values:
+//	none
+void SetCurrentSwitchIndex(int deviceSwitchListIndex)
+{
+	UpdateDeviceList([deviceSwitchListIndex](DeviceListSnapshot& snapshot)
+	{
+		snapshot.switchListIndex = deviceSwitchListIndex;
+		return true;
+	});
+}
@@ -0,0 +1,101 @@
+// ----------------------------------------------------------------------------
+// devicelist.h
+// Immutable snapshots of the toggle list that can be read from any thread
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "togglematcher.h"
+
+// DeviceTable
+// Device rows laid out as parallel arrays indexed by row.  The names and ids
+// are packed back to back (each NUL terminated) in one buffer each and
+// everything the UI needs per row is worked out once when the row is added,
+// so cycling the list, drawing the menu and matching an enumeration never
+// chase pointers or redo the name heuristics.  The toggle list's rows are its
+// entries (with empty ids); the last enumeration's rows are the active
+// devices.
+struct DeviceTable
+{
+	std::wstring names;						// every row's name, each followed by a NUL
+	std::vector<unsigned int> nameOffsets;	// where each row's name starts in names
+	std::wstring ids;						// every row's encoded device id, each followed by a NUL
+	std::vector<unsigned int> idOffsets;	// where each row's id starts in ids
+	std::vector<unsigned char> iconClasses;	// DEVICE_ICON_xxx of each row
+
+	// number of rows
+	int Count() const
+	{
+		return (int)nameOffsets.size();
+	}
+
+	// name of the row at index
+	LPCWSTR Name(int index) const
+	{
+		return names.c_str() + nameOffsets[index];
+	}
+
+	// encoded device id of the row at index
+	LPCWSTR Id(int index) const
+	{
+		return ids.c_str() + idOffsets[index];
+	}
+
+	void Append(const std::wstring& name, const std::wstring& id = std::wstring());
+	void Assign(const std::vector<std::wstring>& deviceIds, const std::vector<std::wstring>& deviceNames);
+	int FindId(const std::wstring& id) const;
+};
+
+// DeviceListSnapshot
+// The app's device state at one point in time.  Once published a snapshot is
+// never modified - writers copy it, change the copy and publish that - so a
+// reader holding one sees a consistent list for as long as it keeps it.
+// Changing the toggle list itself means publishing a new snapshot so its
+// matcher is compiled again.
+struct DeviceListSnapshot
+{
+	DeviceTable switchTable;					// the toggle list entries
+	int switchListIndex;						// the index of the current output device
+	ULONGLONG availableMask;					// bit per switch list entry, set if the device is active
+	DeviceTable activeTable;					// the active output devices at the last enumeration
+	bool activeDevicesEnumerated;				// false until availableMask is built from activeTable
+	std::shared_ptr<const ToggleMatcher> matcher;	// the toggle list entries compiled for matching device names
+
+	DeviceListSnapshot() : switchListIndex(-1), availableMask(~0ULL), activeDevicesEnumerated(false)
+	{
+	}
+
+	// number of entries in the toggle list
+	int SwitchCount() const
+	{
+		return switchTable.Count();
+	}
+
+	// name of the toggle list entry at deviceSwitchListIndex
+	LPCWSTR SwitchName(int deviceSwitchListIndex) const
+	{
+		return switchTable.Name(deviceSwitchListIndex);
+	}
+
+	// DEVICE_ICON_xxx of the toggle list entry at deviceSwitchListIndex
+	int SwitchIconClass(int deviceSwitchListIndex) const
+	{
+		return switchTable.iconClasses[deviceSwitchListIndex];
+	}
+};
+
+typedef std::shared_ptr<const DeviceListSnapshot> DeviceListSnapshotPtr;
+
+// Routines used to read and replace the current device list
+int GetDeviceIconClass(const std::wstring& deviceName);
+DeviceListSnapshotPtr AcquireDeviceList();
+void CompileToggleList(DeviceListSnapshot& snapshot);
+void PublishDeviceList(const std::shared_ptr<DeviceListSnapshot>& snapshot);
+DeviceListSnapshotPtr UpdateDeviceList(const std::function<bool(DeviceListSnapshot&)>& update);
+void SetCurrentSwitchIndex(int deviceSwitchListIndex);
@@ -0,0 +1,204 @@
+// ----------------------------------------------------------------------------
+// devicenotify.cpp
+// Forwards audio endpoint add/remove/state change notifications to the
+// tray window
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "main.h"
+#include "devicenotify.h"
+#include "devicediscovery.h"
+
+#include "Mmdeviceapi.h"
+
+// set while a WM_APP_DEVICE_CHANGE_EVENT is in the queue so a burst of
+// callbacks posts one message instead of one each
+static volatile LONG g_DeviceChangePending = 0;
+
+// callbacks received since the last rebuild
+static volatile LONG g_DeviceChangeEvents = 0;
+
+// when the current burst started (0 if no rebuild is scheduled)
+static ULONGLONG g_DeviceChangeBurstStart = 0;
+
+// DeviceNotificationClient
+// IMMNotificationClient that turns endpoint changes into a
+// WM_APP_DEVICE_CHANGE_EVENT on the tray window.  The callbacks arrive on a
+// system thread and must not block, so all real work happens in WndProc.
+class DeviceNotificationClient : public IMMNotificationClient
+{
+public:
+	DeviceNotificationClient(HWND hWnd) : m_refCount(1), m_hWnd(hWnd)
+	{
+	}
+
+	// IUnknown
+	ULONG STDMETHODCALLTYPE AddRef()
+	{
+		return InterlockedIncrement(&m_refCount);
+	}
+
+	ULONG STDMETHODCALLTYPE Release()
+	{
+		ULONG refCount = InterlockedDecrement(&m_refCount);
+		if (0 == refCount)
+			delete this;
+		return refCount;
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, VOID** ppvInterface)
+	{
+		if ((__uuidof(IUnknown) == riid) || (__uuidof(IMMNotificationClient) == riid))
+		{
+			AddRef();
+			*ppvInterface = (IMMNotificationClient*)this;
+			return S_OK;
+		}
+		*ppvInterface = NULL;
+		return E_NOINTERFACE;
+	}
+
+	// IMMNotificationClient
+	HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR pwstrDeviceId, DWORD dwNewState)
+	{
+		PostDeviceChange();
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR pwstrDeviceId)
+	{
+		PostDeviceChange();
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR pwstrDeviceId)
+	{
+		PostDeviceChange();
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow flow, ERole role, LPCWSTR pwstrDefaultDeviceId)
+	{
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR pwstrDeviceId, const PROPERTYKEY key)
+	{
+		return S_OK;
+	}
+
+private:
+	void PostDeviceChange()
+	{
+		InterlockedIncrement(&g_DeviceChangeEvents);
+		if (0 == InterlockedExchange(&g_DeviceChangePending, 1))
+			PostMessage(m_hWnd, WM_APP_DEVICE_CHANGE_EVENT, 0, 0);
+	}
+
+	volatile LONG	m_refCount;
+	HWND			m_hWnd;
+};
+
+// the enumerator the client is registered with - needed again to unregister
+static IMMDeviceEnumerator*			g_pNotifyEnumerator = nullptr;
+static DeviceNotificationClient*	g_pNotificationClient = nullptr;
+
+
+// RegisterDeviceNotifications
+// Start posting WM_APP_DEVICE_CHANGE_EVENT to hWnd whenever an audio endpoint
+// is added, removed, or changes state (ie: unplugged)
+//
+// Parameters:
+//	hWnd	Window that receives the notifications
+//
+// Return values:
+//	0	Success - notifications registered
+//	-1	Failure - device changes will not be reported
+int RegisterDeviceNotifications(HWND hWnd)
+{
+	if (g_pNotificationClient)
+		return 0;
+
+	// COM stays initialized for as long as the callback is registered
+	HRESULT hr = CoInitialize(NULL);
+	if (SUCCEEDED(hr))
+	{
+		// register on the same enumerator the rest of the app uses, through a
+		// pointer that is valid on this (UI) thread
+		hr = GetAudioDeviceEnumerator(&g_pNotifyEnumerator);
+		if (SUCCEEDED(hr))
+		{
+			g_pNotificationClient = new DeviceNotificationClient(hWnd);
+			hr = g_pNotifyEnumerator->RegisterEndpointNotificationCallback(g_pNotificationClient);
+			if (SUCCEEDED(hr))
+				return 0;
+
+			g_pNotificationClient->Release();
+			g_pNotificationClient = nullptr;
+			g_pNotifyEnumerator->Release();
+			g_pNotifyEnumerator = nullptr;
+		}
+		CoUninitialize();
+	}
+	return -1;
+}
+
+// UnregisterDeviceNotifications
+// Stop listening for audio device changes
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void UnregisterDeviceNotifications()
+{
+	if (g_pNotificationClient)
+	{
+		g_pNotifyEnumerator->UnregisterEndpointNotificationCallback(g_pNotificationClient);
+		g_pNotificationClient->Release();
+		g_pNotificationClient = nullptr;
+		g_pNotifyEnumerator->Release();
+		g_pNotifyEnumerator = nullptr;
+		CoUninitialize();
+	}
+}
+
+// ScheduleDeviceChangeRebuild
+// Called for WM_APP_DEVICE_CHANGE_EVENT.  (Re)starts the coalescing timer so
+// the rebuild happens once the burst of changes settles down.  A burst that
+// never settles is still rebuilt DEVICE_CHANGE_MAX_DELAY_MS after it started.
+//
+// Parameters:
+//	hWnd	Window that receives the WM_TIMER
+//
+// Return values:
+//	none
+void ScheduleDeviceChangeRebuild(HWND hWnd)
+{
+	// later callbacks may post again
+	InterlockedExchange(&g_DeviceChangePending, 0);
+
+	ULONGLONG now = GetTickCount64();
+	if (0 == g_DeviceChangeBurstStart)
+		g_DeviceChangeBurstStart = now;
+
+	if (now - g_DeviceChangeBurstStart < DEVICE_CHANGE_MAX_DELAY_MS)
+		SetTimer(hWnd, IDT_DEVICE_CHANGE_TIMER, DEVICE_CHANGE_COALESCE_MS, NULL);
+}
+
+// CompleteDeviceChangeRebuild
+// Called when the coalescing timer fires, right before the rebuild
+//
+// Parameters:
+//	hWnd	Window that owns the timer
+//
+// Return values:
+//	Number of device change callbacks the rebuild covers
+LONG CompleteDeviceChangeRebuild(HWND hWnd)
+{
+	KillTimer(hWnd, IDT_DEVICE_CHANGE_TIMER);
+	g_DeviceChangeBurstStart = 0;
+	return InterlockedExchange(&g_DeviceChangeEvents, 0);
+}
@@ -0,0 +1,23 @@
+// ----------------------------------------------------------------------------
+// devicenotify.h
+// Forwards audio endpoint add/remove/state change notifications to the
+// tray window
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+// device changes are rebuilt once the events stop for DEVICE_CHANGE_COALESCE_MS,
+// or DEVICE_CHANGE_MAX_DELAY_MS after the first one if they keep coming
+#define DEVICE_CHANGE_COALESCE_MS		250
+#define DEVICE_CHANGE_MAX_DELAY_MS		1000
+#define IDT_DEVICE_CHANGE_TIMER			1
+
+// Routines used to start/stop listening for audio device changes
+int RegisterDeviceNotifications(HWND hWnd);
+void UnregisterDeviceNotifications();
+
+// Routines used to coalesce bursts of device changes into one rebuild
+void ScheduleDeviceChangeRebuild(HWND hWnd);
+LONG CompleteDeviceChangeRebuild(HWND hWnd);
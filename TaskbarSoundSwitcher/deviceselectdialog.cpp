@@ -8,9 +8,13 @@
 #include "main.h"
 #include "deviceselectdialog.h"
 #include "devicediscovery.h"
+#include "devicelist.h"
+#include "configwriter.h"
 
 // DeviceSelectionDialogProc
-// This routine handles the events from the device selection dialog box 
+// This routine handles the events from the device selection dialog box.  The
+// dialog's lParam is the list of discovered devices shown in the listbox; it
+// only replaces the app's device list when OK is pressed.
 //
 // Parameters:
 //	Standard windows proc parameters
@@ -22,16 +26,21 @@ BOOL CALLBACK DeviceSelectionDialogProc(HWND hwnd, UINT Message, WPARAM wParam,
 {
 	HWND hwndListBox;
 	int count = 0;
-	int *buf = NULL;
+	std::vector<int> selectedItems;
+	const std::vector<std::wstring>* pDiscoveredDevices = (const std::vector<std::wstring>*)GetWindowLongPtr(hwnd, DWLP_USER);
+	std::shared_ptr<DeviceListSnapshot> deviceList;
+	int deviceSwitchListIndex = 0;
 
 	switch (Message)
 	{
 		//case WM_CREATE:
 	case WM_INITDIALOG:
 		// populate the listbox	with all the discovered devices
-		for (unsigned int i = 0; i < g_EnumeratedDeviceList.size(); i++)
+		pDiscoveredDevices = (const std::vector<std::wstring>*)lParam;
+		SetWindowLongPtr(hwnd, DWLP_USER, (LONG_PTR)pDiscoveredDevices);
+		for (unsigned int i = 0; i < pDiscoveredDevices->size(); i++)
 		{
-			SendDlgItemMessage(hwnd, IDC_LIST1, LB_ADDSTRING, 0, (LPARAM)g_EnumeratedDeviceList[i].c_str());
+			SendDlgItemMessage(hwnd, IDC_LIST1, LB_ADDSTRING, 0, (LPARAM)(*pDiscoveredDevices)[i].c_str());
 		}
 		break;
 
@@ -44,29 +53,38 @@ BOOL CALLBACK DeviceSelectionDialogProc(HWND hwnd, UINT Message, WPARAM wParam,
 			count = (int)SendMessage(hwndListBox, LB_GETSELCOUNT, 0, 0);
 
 			// get the list of selected items
-			buf = (int*)malloc(count*sizeof(int));
-			assert(nullptr != buf);
-			SendMessage(hwndListBox, LB_GETSELITEMS, (WPARAM)count, (LPARAM)buf);
-
-			// clear the recorded list of selected items			
-			g_EnumeratedDeviceListSwitchIndexes.clear();
+			if (count > 0)
+			{
+				selectedItems.resize(count);
+				count = (int)SendMessage(hwndListBox, LB_GETSELITEMS, (WPARAM)count, (LPARAM)&selectedItems[0]);
+				selectedItems.resize((count > 0) ? count : 0);
+			}
 
-			// store the selected items
-			for (int i = 0; i < count; i++)
+			// publish the discovered devices and the selected items together
+			deviceList = std::make_shared<DeviceListSnapshot>();
+			for (unsigned int i = 0; i < selectedItems.size(); i++)
 			{
-				g_EnumeratedDeviceListSwitchIndexes.push_back(buf[i]);
+				deviceList->switchTable.Append((*pDiscoveredDevices)[selectedItems[i]]);
 			}
+			PublishDeviceList(deviceList);
+			count = (int)selectedItems.size();
 
-			free(buf);
+			// the prefetched endpoint and availability belonged to the old list
+			InvalidateAudioOutputDevicePrefetch();
+			RefreshDeviceAvailability(NULL);
 
-			// figure out if any of these are the current audio device
-			DiscoverCurrentAudioOutputDevice(g_DeviceSwitchListIndex);
+			if (count)
+			{
+				// figure out if any of these are the current audio device
+				DiscoverCurrentAudioOutputDevice(deviceSwitchListIndex);
+				SetCurrentSwitchIndex(deviceSwitchListIndex);
 
-			// the the audio source off the list
-			SetActiveAudioOutputDevice(g_DeviceSwitchListIndex);
+				// the the audio source off the list
+				SetActiveAudioOutputDevice(deviceSwitchListIndex, false);
 
-			// change the icon to speakers
-			ChangeIcon(g_hWnd);
+				// change the icon to speakers
+				ChangeIcon(g_hWnd);
+			}
 
 			EndDialog(hwnd, IDOK);
 			break;
@@ -86,8 +104,7 @@ BOOL CALLBACK DeviceSelectionDialogProc(HWND hwnd, UINT Message, WPARAM wParam,
 // Routine discovers all audio output on this machine and puts them into a dialog  
 // box for selection.  The user can select as many of the items as they want and
 // upon pressing ok, it then writes out which items the user selected to the 
-// config file and stores indexes to those devices in this list
-// g_EnumeratedDeviceListSwitchIndexes
+// config file and publishes them as the app's device list
 //
 // Parameters:
 //	none
@@ -97,17 +114,18 @@ BOOL CALLBACK DeviceSelectionDialogProc(HWND hwnd, UINT Message, WPARAM wParam,
 void SelectDevicesDialog()
 {
 	// discover the entire list of devices into a list of strings
-	DiscoverAllAudioOutputDevices(g_EnumeratedDeviceList);
+	std::vector<std::wstring> discoveredDevices;
+	DiscoverAllAudioOutputDevices(discoveredDevices);
 
 	// pop up a dialog box to let user choose what to swap between
-	if (0 != g_EnumeratedDeviceList.size())
+	if (0 != discoveredDevices.size())
 	{
-		if (DialogBox(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_DEVICE_SELECT), g_hWnd, (DLGPROC)DeviceSelectionDialogProc) == IDOK)
+		if (DialogBoxParam(GetModuleHandle(NULL), MAKEINTRESOURCE(IDD_DEVICE_SELECT), g_hWnd, (DLGPROC)DeviceSelectionDialogProc, (LPARAM)&discoveredDevices) == IDOK)
 		{
 			// write out the selected devices to the config file
-			WriteDeviceToggleStrings();
+			RequestConfigWrite();
 
-			if (0==g_EnumeratedDeviceListSwitchIndexes.size())
+			if (0==AcquireDeviceList()->SwitchCount())
 			{
 				MessageBox(nullptr, L"There were no audio devices selected to toggle.", L"No audio devices selected", MB_OK);
 			}
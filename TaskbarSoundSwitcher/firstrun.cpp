@@ -0,0 +1,96 @@
+// ----------------------------------------------------------------------------
+// firstrun.cpp
+// Seeds the toggle list on first run from a deployment policy file so
+// unattended installs never wait on the device selection dialog
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "main.h"
+#include "firstrun.h"
+#include "deploypolicy.h"
+#include "devicediscovery.h"
+#include "devicelist.h"
+#include "statusblock.h"
+#include "configwriter.h"
+#include "backendtrace.h"
+
+
+// DeployPolicyFilename
+// Works out the full path of DeployPolicy.cfg in the folder the app's exe is in
+//
+// Parameters:
+//	policyFilename	Set to the path
+//
+// Return values:
+//	0	Success
+//	-1	The exe's path couldn't be read
+static int DeployPolicyFilename(std::string& policyFilename)
+{
+	char modulePath[MAX_PATH];
+	DWORD length = GetModuleFileNameA(NULL, modulePath, MAX_PATH);
+	if ((0 == length) || (MAX_PATH == length))
+		return -1;
+
+	policyFilename = modulePath;
+	policyFilename = policyFilename.substr(0, policyFilename.find_last_of('\\') + 1) + "DeployPolicy.cfg";
+	return 0;
+}
+
+// SeedToggleListFromPolicy
+// Called on first run (no config file) once the audio devices are up.  If a
+// deployment policy exists the devices are classified and the toggle list
+// is built from it and saved, instead of opening the selection dialog.  The
+// dialog stays available from the tray menu.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	0	The policy was applied (the list may be empty if no device matched)
+//	-1	There is no policy - the devices need to be selected by hand
+int SeedToggleListFromPolicy()
+{
+	std::string policyFilename;
+	std::vector<int> classOrder;
+	if ((0 != DeployPolicyFilename(policyFilename)) || (0 != LoadDeployPolicy(policyFilename, classOrder)))
+		return -1;
+
+	LONGLONG startTime = BackendTraceTimestamp();
+	std::vector<std::wstring> deviceIds;
+	std::vector<std::wstring> deviceNames;
+	std::vector<ULONG> formFactors;
+	EnumerateAudioOutputDevices(deviceIds, deviceNames, formFactors);
+
+	std::vector<int> deviceClasses(deviceNames.size());
+	for (unsigned int i = 0; i < deviceNames.size(); i++)
+	{
+		deviceClasses[i] = ClassifyAudioOutputDevice(deviceNames[i], formFactors[i]);
+	}
+
+	std::shared_ptr<DeviceListSnapshot> deviceList = std::make_shared<DeviceListSnapshot>();
+	for (unsigned int c = 0; c < classOrder.size(); c++)
+	{
+		for (unsigned int i = 0; i < deviceNames.size(); i++)
+		{
+			if (deviceClasses[i] == classOrder[c])
+				deviceList->switchTable.Append(deviceNames[i]);
+		}
+	}
+	PublishDeviceList(deviceList);
+	InvalidateAudioOutputDevicePrefetch();
+
+	WCHAR summary[64];
+	swprintf_s(summary, L"devices=%u selected=%d", (unsigned int)deviceNames.size(), deviceList->SwitchCount());
+	TraceBackendCall(L"FirstRunSeed", startTime, S_OK, summary);
+
+	if (deviceList->SwitchCount())
+	{
+		RequestConfigWrite();
+	}
+	else
+	{
+		ShowTrayNotice(L"No audio devices selected", L"None of your audio devices matched the deployment policy. Right-click the icon to select them.");
+	}
+	return 0;
+}
@@ -0,0 +1,12 @@
+// ----------------------------------------------------------------------------
+// firstrun.h
+// Seeds the toggle list on first run from a deployment policy file so
+// unattended installs never wait on the device selection dialog
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+// Routines used to build the first toggle list without asking the user
+int SeedToggleListFromPolicy();
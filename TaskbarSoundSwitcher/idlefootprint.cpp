@@ -0,0 +1,53 @@
+// ----------------------------------------------------------------------------
+// idlefootprint.cpp
+// Optional low footprint mode that lets go of cached audio objects and
+// trims the working set while the app sits idle
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "idlefootprint.h"
+#include "devicediscovery.h"
+#include "backendtrace.h"
+
+bool g_LowFootprintEnabled = false;
+
+
+// ScheduleIdleTrim
+// (Re)starts the idle countdown.  Called after anything that warms the
+// caches back up, ie: a switch and its prefetch.
+//
+// Parameters:
+//	hWnd	Window that receives the WM_TIMER
+//
+// Return values:
+//	none
+void ScheduleIdleTrim(HWND hWnd)
+{
+	if (g_LowFootprintEnabled)
+		SetTimer(hWnd, IDT_IDLE_TRIM_TIMER, IDLE_TRIM_DELAY_MS, NULL);
+}
+
+// EnterIdleMode
+// Called when the idle countdown runs out.  Drops the prefetched endpoint
+// and the warm policy config object, then hands the app's pages back to the
+// system.  The device enumerator is kept: the notification callback holds it
+// for as long as the app runs, so releasing the cache would free nothing.
+// The timer is one-shot so an idle app isn't woken up again.  The first
+// switch afterwards pays to recreate what was released.
+//
+// Parameters:
+//	hWnd	Window that owns the timer
+//
+// Return values:
+//	none
+void EnterIdleMode(HWND hWnd)
+{
+	KillTimer(hWnd, IDT_IDLE_TRIM_TIMER);
+	TraceResourceUsage(L"IdleBefore");
+
+	ReleaseWarmAudioObjects();
+	SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
+
+	TraceResourceUsage(L"IdleTrimmed");
+}
@@ -0,0 +1,20 @@
+// ----------------------------------------------------------------------------
+// idlefootprint.h
+// Optional low footprint mode that lets go of cached audio objects and
+// trims the working set while the app sits idle
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+// the app is trimmed once nothing happened for IDLE_TRIM_DELAY_MS
+#define IDLE_TRIM_DELAY_MS			60000
+#define IDT_IDLE_TRIM_TIMER			3
+
+// true if started with /lowfootprint
+extern bool g_LowFootprintEnabled;
+
+// Routines used to trim the app while it is idle
+void ScheduleIdleTrim(HWND hWnd);
+void EnterIdleMode(HWND hWnd);
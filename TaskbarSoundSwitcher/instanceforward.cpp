@@ -0,0 +1,131 @@
+// ----------------------------------------------------------------------------
+// instanceforward.cpp
+// Hands the command line of a second copy of the app to the running one so
+// shortcuts and macro tools can switch devices by launching the exe
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "main.h"
+#include "instanceforward.h"
+#include "traywindow.h"
+#include "devicediscovery.h"
+#include "devicelist.h"
+#include "backendtrace.h"
+
+#include <string>
+
+
+// ForwardCommandLine
+// Called by a second copy of the app instead of starting up.  Sends its
+// command line to the running copy and waits for the switch to be made.
+// Nothing else (icons, COM, the config file) is loaded on this path.
+//
+// Parameters:
+//	hWnd		Window of the running copy
+//	lpCmdLine	The second copy's command line (may be NULL)
+//	launchTime	GetTickCount() when the second copy started
+//
+// Return values:
+//	0	Success - the running copy handled the command line
+//	1	The running copy is an older version that doesn't take command lines
+//	-1	Failure - the running copy didn't answer in time
+int ForwardCommandLine(HWND hWnd, LPCTSTR lpCmdLine, LONG launchTime)
+{
+	ForwardedCommandLine forwarded;
+	forwarded.launchTime = launchTime;
+	wcsncpy_s(forwarded.commandLine, lpCmdLine ? lpCmdLine : L"", _TRUNCATE);
+
+	COPYDATASTRUCT copyData;
+	copyData.dwData = COPYDATA_FORWARDED_COMMAND_LINE;
+	copyData.cbData = sizeof(forwarded);
+	copyData.lpData = &forwarded;
+
+	DWORD_PTR handled = FALSE;
+	if (!SendMessageTimeout(hWnd, WM_COPYDATA, 0, (LPARAM)&copyData, SMTO_ABORTIFHUNG, FORWARD_COMMAND_TIMEOUT_MS, &handled))
+		return -1;
+	return handled ? 0 : 1;
+}
+
+// FindToggleEntry
+// Finds the first toggle list entry whose name contains the given text
+//
+// Parameters:
+//	deviceList	The device list snapshot to search
+//	name		Text to look for (ie: "Headset")
+//
+// Return values:
+//	>=0		Index of the entry
+//	-1		No entry contains the text
+static int FindToggleEntry(const DeviceListSnapshot& deviceList, const std::wstring& name)
+{
+	for (int i = 0; i < deviceList.SwitchCount(); i++)
+	{
+		if (wcsstr(deviceList.SwitchName(i), name.c_str()))
+			return i;
+	}
+	return -1;
+}
+
+// OnForwardedCommandLine
+// Handles WM_COPYDATA from a second copy of the app.  The command line picks
+// what to switch to:
+//	/device:<name>	The first toggle list entry containing name.  An
+//					unquoted name ends at the first space, so quote
+//					names that have spaces
+//	/prev			The previous available entry
+//	anything else	The next available entry, same as a double-click
+// The time from the second copy's launch to the new icon is recorded as the
+// switch's input latency.
+//
+// Parameters:
+//	hWnd		Window handle of the tray icon
+//	pCopyData	The WM_COPYDATA payload
+//
+// Return values:
+//	true	The command line was handled
+//	false	The data wasn't a forwarded command line
+bool OnForwardedCommandLine(HWND hWnd, const COPYDATASTRUCT* pCopyData)
+{
+	if (!pCopyData || (COPYDATA_FORWARDED_COMMAND_LINE != pCopyData->dwData) || (sizeof(ForwardedCommandLine) != pCopyData->cbData))
+		return false;
+
+	// copy it out so a bad sender can't leave it unterminated
+	ForwardedCommandLine forwarded = *(const ForwardedCommandLine*)pCopyData->lpData;
+	forwarded.commandLine[MAX_FORWARDED_COMMAND_LINE - 1] = 0;
+
+	LPCWSTR deviceArg = wcsstr(forwarded.commandLine, L"/device:");
+	if (deviceArg)
+	{
+		std::wstring name = deviceArg + wcslen(L"/device:");
+		if (!name.empty() && (L'"' == name[0]))
+			name = name.substr(1, name.find(L'"', 1) - 1);
+		else
+			name = name.substr(0, name.find_first_of(L" \t"));
+
+		DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+		int index = name.empty() ? -1 : FindToggleEntry(*deviceList, name);
+		if (index >= 0)
+		{
+			SwitchToDevice(hWnd, index, BackendTraceTimestamp(), forwarded.launchTime);
+		}
+		else
+		{
+			std::wstring notice = name + L" is not in the list of devices to switch between.";
+			ShowTrayNotice(L"Unknown audio device", notice.c_str());
+		}
+	}
+	else if (wcsstr(forwarded.commandLine, L"/prev"))
+	{
+		LONGLONG switchStart = BackendTraceTimestamp();
+		DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+		int index = PreviousAvailableSwitchIndex(*deviceList, deviceList->switchListIndex);
+		if (index >= 0)
+			SwitchToDevice(hWnd, index, switchStart, forwarded.launchTime);
+	}
+	else
+	{
+		OnTrayDoubleClick(hWnd, forwarded.launchTime);
+	}
+	return true;
+}
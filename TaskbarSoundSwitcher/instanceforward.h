@@ -0,0 +1,28 @@
+// ----------------------------------------------------------------------------
+// instanceforward.h
+// Hands the command line of a second copy of the app to the running one so
+// shortcuts and macro tools can switch devices by launching the exe
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+// WM_COPYDATA dwData that marks a ForwardedCommandLine
+#define COPYDATA_FORWARDED_COMMAND_LINE		0x54535331
+#define MAX_FORWARDED_COMMAND_LINE			1024
+
+// how long the second copy waits for the running one to make the switch
+#define FORWARD_COMMAND_TIMEOUT_MS			10000
+
+// ForwardedCommandLine
+// What the second copy sends the running one
+struct ForwardedCommandLine
+{
+	LONG launchTime;								// GetTickCount() when the second copy started
+	WCHAR commandLine[MAX_FORWARDED_COMMAND_LINE];	// its command line, NUL terminated
+};
+
+// Routines used to forward a command line between instances
+int ForwardCommandLine(HWND hWnd, LPCTSTR lpCmdLine, LONG launchTime);
+bool OnForwardedCommandLine(HWND hWnd, const COPYDATASTRUCT* pCopyData);
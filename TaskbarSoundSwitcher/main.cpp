@@ -10,26 +10,67 @@
 #include <stdio.h>
 
 #include <shellapi.h>		// for NOTIFYICONDATA
-#include <algorithm>		// std::transform
 #include <direct.h>			// getenv_s()
 #include <sys/stat.h>		// _stat()
+#include <mutex>
 
 #include "resource.h"		// for icon IDI_xxxx identifiers
 #include "main.h"
 #include "deviceselectdialog.h"
 #include "devicediscovery.h"
+#include "devicelist.h"
+#include "backendtrace.h"
+#include "backendwatchdog.h"
+#include "devicenotify.h"
+#include "configwatch.h"
+#include "statusblock.h"
+#include "statuspublisher.h"
+#include "switchtiming.h"
+#include "configwriter.h"
+#include "backgroundtasks.h"
+#include "readinessprobe.h"
+#include "traywindow.h"
+#include "idlefootprint.h"
+#include "instanceforward.h"
+#include "firstrun.h"
 
 // App variables
 const UINT	WM_APP_TRAY_EVENT = WM_USER;
+const UINT	WM_APP_PREFETCH_EVENT = WM_USER + 1;
+const UINT	WM_APP_DEVICE_CHANGE_EVENT = WM_USER + 2;
+const UINT	WM_APP_PREFETCH_RESOLVED_EVENT = WM_USER + 3;
+const UINT	WM_APP_READINESS_PROBE_EVENT = WM_USER + 4;
+const UINT	WM_APP_DEVICE_REBUILD_EVENT = WM_USER + 5;
+const UINT	WM_APP_CONFIG_RELOAD_EVENT = WM_USER + 6;
 HINSTANCE	g_hInstance = NULL;				
 HICON		g_hSpeakerIcon = NULL;
 HICON		g_hHeadphonesIcon = NULL;
 HWND		g_hWnd = NULL;							
 
-// audio device lists
-int	g_DeviceSwitchListIndex = -1;						
-std::vector<std::wstring> g_EnumeratedDeviceList;
-std::vector<int> g_EnumeratedDeviceListSwitchIndexes;
+// audio device lists live in devicelist.cpp
+bool g_FailoverEnabled = true;
+
+// no config file was found - show the selection dialog once the devices are up
+static bool g_SelectDevicesWhenReady = false;
+
+// the newest enumeration a device change rebuild has made.  Rebuilds are
+// numbered so one that finishes after a newer one is ignored.
+static std::mutex					g_RebuildResultLock;
+static unsigned int					g_RebuildResultSequence = 0;
+static HRESULT						g_RebuildResultHr = E_FAIL;
+static std::vector<std::wstring>	g_RebuildResultIds;
+static std::vector<std::wstring>	g_RebuildResultNames;
+static LONGLONG						g_RebuildStartTime = 0;
+static unsigned int					g_RebuildSequence = 0;			// UI thread only
+static unsigned int					g_RebuildAppliedSequence = 0;	// UI thread only
+static LONG							g_RebuildEvents = 0;			// UI thread only
+
+// the newest config file a background reload has read and parsed, waiting
+// for the UI thread to apply it
+static std::mutex					g_ConfigReloadLock;
+static bool							g_ConfigReloadPending = false;
+static std::vector<std::wstring>	g_ConfigReloadNames;
+static LONGLONG						g_ConfigReloadStartTime = 0;
 
 // LoadStringSafe
 // Helper function to load string resources
@@ -52,15 +93,17 @@ void LoadStringSafe(UINT nStrID, LPTSTR szBuf, UINT nBufLen)
 // BuildResourceFilenameString
 // Locates the configuration file in %APPDATA%/TaskbarSoundSwitcher/ folder per
 // Microsoft's programming guidelines for config files. The config filename is 
-// AudioSources.cfg and holds the 'friendly' device string names
+// AudioSources.cfg and holds the 'friendly' device string names.  Other app
+// files (ie: the /trace log) live in the same folder.
 //
 // Parameters:
 //	fullPathFilename	The full file path to the resource file
+//	filename			Name of the file in the app's %APPDATA% folder
 //
 // Return values:
 //	0	Success - fullPathFilename will contain the full file path
 //	-1	Failure - full path not found
-int BuildResourceFilenameString(std::string& fullPathFilename)
+int BuildResourceFilenameString(std::string& fullPathFilename, const char* filename)
 {
 	size_t requiredSize = 0;
 
@@ -97,7 +140,7 @@ int BuildResourceFilenameString(std::string& fullPathFilename)
 	}
 
 	// attempt to open the config file
-	fullPathFilename = dirName + "\\AudioSources.cfg";
+	fullPathFilename = dirName + "\\" + filename;
 	return 0;
 }
 
@@ -113,6 +156,10 @@ int BuildResourceFilenameString(std::string& fullPathFilename)
 //	-1	Failure - icon not changed
 int ChangeIcon(HWND hWnd)
 {
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if ((deviceList->switchListIndex < 0) || (deviceList->switchListIndex >= deviceList->SwitchCount()))
+		return -1;
+
 	// change the taskbar icon
 	NOTIFYICONDATA stData;
 	ZeroMemory(&stData, sizeof(stData));
@@ -121,9 +168,7 @@ int ChangeIcon(HWND hWnd)
 	stData.uFlags = NIF_ICON;
 
 	// do a little bit of heuristic logic here to figure out which icon might be more appropriate
-	std::wstring currentDeviceName = g_EnumeratedDeviceList[g_EnumeratedDeviceListSwitchIndexes[g_DeviceSwitchListIndex]];
-	std::transform(currentDeviceName.begin(), currentDeviceName.end(), currentDeviceName.begin(), ::tolower);
-	if ((std::string::npos != currentDeviceName.find(L"headphone")) || (std::string::npos != currentDeviceName.find(L"headset")))
+	if (DEVICE_ICON_HEADPHONES == deviceList->SwitchIconClass(deviceList->switchListIndex))
 	{
 		stData.hIcon = g_hHeadphonesIcon;
 	}
@@ -139,73 +184,407 @@ int ChangeIcon(HWND hWnd)
 }
 
 
-// ReadDeviceToggleStrings 
-// Open and read the contents of the config file or pop up the device selection 
-// dialog if the config file doesn't exist
+// ShowTrayNotice
+// Pop up a balloon warning over the tray icon
 //
 // Parameters:
+//	title	Balloon title
+//	text	Balloon text
+//
+// Return values:
 //	none
+void ShowTrayNotice(LPCWSTR title, LPCWSTR text)
+{
+	NOTIFYICONDATA stData;
+	ZeroMemory(&stData, sizeof(stData));
+	stData.cbSize = sizeof(stData);
+	stData.hWnd = g_hWnd;
+	stData.uFlags = NIF_INFO;
+	stData.dwInfoFlags = NIIF_WARNING;
+	wcsncpy_s(stData.szInfoTitle, title, _TRUNCATE);
+	wcsncpy_s(stData.szInfo, text, _TRUNCATE);
+	Shell_NotifyIcon(NIM_MODIFY, &stData);
+}
+
+
+// OnAudioReady
+// Called by the readiness probe once the audio devices are up after startup.
+// Shows the device selection dialog if there's no config file yet, otherwise
+// figures out which toggle list entry to start on and sets it.
+//
+// Parameters:
+//	hWnd		Window handle of the tray icon
+//	hrEnumerate	Result of the probe's enumeration
+//	deviceIds	Encoded ids the probe's enumeration found
+//	deviceNames	Friendly names the probe's enumeration found, same order
 //
 // Return values:
 //	none
-void ReadDeviceToggleStrings()
+void OnAudioReady(HWND hWnd, HRESULT hrEnumerate, const std::vector<std::wstring>& deviceIds, const std::vector<std::wstring>& deviceNames)
+{
+	// no config file found - seed the list from the deployment policy, or
+	// without one manually select the audio devices to toggle
+	if (g_SelectDevicesWhenReady)
+	{
+		g_SelectDevicesWhenReady = false;
+		if (0 != SeedToggleListFromPolicy())
+		{
+			SelectDevicesDialog();
+			return;
+		}
+	}
+
+	// Find out which of the toggle devices are plugged in
+	ApplyDeviceAvailability(hrEnumerate, deviceIds, deviceNames, NULL);
+
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if (deviceList->SwitchCount())
+	{
+		// Figure out what the current audio device is and set the 
+		// the default/current playback device index if it's also  
+		// in the current device toggle list.  Otherwise start on 
+		// the best device that is plugged in - or leave things alone
+		// if none of them are
+		int deviceSwitchListIndex = 0;
+		if (0 != DiscoverCurrentAudioOutputDevice(deviceSwitchListIndex))
+			deviceSwitchListIndex = BestAvailableSwitchIndex(*deviceList);
+
+		if (deviceSwitchListIndex >= 0)
+		{
+			SetCurrentSwitchIndex(deviceSwitchListIndex);
+
+			// Set the audio output to one of the devices in the 
+			// selected list
+			SetActiveAudioOutputDevice(deviceSwitchListIndex, false);
+
+			// Change the icon to match the playback device
+			ChangeIcon(hWnd);
+		}
+	}
+}
+
+
+// OnAudioDevicesChanged
+// Called once a burst of audio endpoint adds, removes or state changes has
+// settled.  Starts the enumeration on a background worker; the rebuild is
+// finished by OnDeviceRebuildResult once it is back.
+//
+// Parameters:
+//	hWnd	Window handle of the tray icon
+//	events	Number of device change callbacks this rebuild covers
+//
+// Return values:
+//	none
+void OnAudioDevicesChanged(HWND hWnd, LONG events)
+{
+	if (0 == AcquireDeviceList()->SwitchCount())
+		return;
+
+	g_RebuildEvents += events;
+	unsigned int sequence = ++g_RebuildSequence;
+	QueueBackgroundTask(TASK_PRIORITY_HIGH, L"DeviceRebuild", 0, [hWnd, sequence]()
+	{
+		LONGLONG startTime = BackendTraceTimestamp();
+		std::vector<std::wstring> deviceIds;
+		std::vector<std::wstring> deviceNames;
+		HRESULT hr = EnumerateAudioOutputDevices(deviceIds, deviceNames);
+		{
+			std::lock_guard<std::mutex> lock(g_RebuildResultLock);
+			if (sequence < g_RebuildResultSequence)
+				return;
+			g_RebuildResultSequence = sequence;
+			g_RebuildResultHr = hr;
+			g_RebuildResultIds.swap(deviceIds);
+			g_RebuildResultNames.swap(deviceNames);
+			g_RebuildStartTime = startTime;
+		}
+		PostMessage(hWnd, WM_APP_DEVICE_REBUILD_EVENT, 0, 0);
+	});
+}
+
+
+// OnDeviceRebuildResult
+// Takes a device change rebuild's enumeration on the UI thread.  Updates
+// which toggle list entries are available and, if the current device went
+// away, fails over to the highest priority entry that is still available.
+//
+// Parameters:
+//	hWnd	Window handle of the tray icon
+//
+// Return values:
+//	none
+void OnDeviceRebuildResult(HWND hWnd)
+{
+	static unsigned int rebuildCount = 0;
+
+	std::vector<std::wstring> deviceIds;
+	std::vector<std::wstring> deviceNames;
+	HRESULT hr;
+	LONGLONG startTime;
+	{
+		std::lock_guard<std::mutex> lock(g_RebuildResultLock);
+		if (g_RebuildResultSequence <= g_RebuildAppliedSequence)
+			return;
+		g_RebuildAppliedSequence = g_RebuildResultSequence;
+		hr = g_RebuildResultHr;
+		deviceIds.swap(g_RebuildResultIds);
+		deviceNames.swap(g_RebuildResultNames);
+		startTime = g_RebuildStartTime;
+	}
+
+	DeviceListDiff diff;
+	ApplyDeviceAvailability(hr, deviceIds, deviceNames, &diff);
+
+	WCHAR summary[128];
+	swprintf_s(summary, L"events=%ld rebuilds=%u added=%u removed=%u renamed=%u", g_RebuildEvents, ++rebuildCount,
+		(unsigned int)diff.addedIds.size(), (unsigned int)diff.removedIds.size(), (unsigned int)diff.renamedIds.size());
+	TraceBackendCall(L"DeviceChangeRebuild", startTime, hr, summary);
+	g_RebuildEvents = 0;
+
+	// only the devices that changed can affect the prefetch or the current device
+	if (diff.Empty())
+		return;
+	bool prefetchDropped = InvalidateAudioOutputDevicePrefetch(diff);
+
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if (g_FailoverEnabled && !IsSwitchIndexAvailable(*deviceList, deviceList->switchListIndex))
+	{
+		int bestIndex = BestAvailableSwitchIndex(*deviceList);
+		if ((bestIndex >= 0) && (0 == SetActiveAudioOutputDevice(bestIndex, false)))
+		{
+			SetCurrentSwitchIndex(bestIndex);
+			ChangeIcon(hWnd);
+		}
+	}
+	else if (prefetchDropped)
+	{
+		PostMessage(hWnd, WM_APP_PREFETCH_EVENT, 0, 0);
+	}
+}
+
+
+// LoadDeviceToggleStrings 
+// Open and read the contents of the config file
+//
+// Parameters:
+//	toggleNames		Set to the device strings in the file, in file order
+//
+// Return values:
+//	0	Success - toggleNames holds the file's entries
+//	-1	Failure - the config file doesn't exist or is empty
+int LoadDeviceToggleStrings(std::vector<std::wstring>& toggleNames)
 {
 	FILE* fp = nullptr;
+	toggleNames.clear();
 	
 	// Attempt to open the resource file
 	std::string fullPathFilename;
-	int result = BuildResourceFilenameString(fullPathFilename);
+	int result = BuildResourceFilenameString(fullPathFilename, "AudioSources.cfg");
 	if (0 == result)
 	{
 		result = fopen_s(&fp, fullPathFilename.c_str(), "r");
 	}
-
-	// no config file found - manually select the audio devices to toggle
 	if (NULL == fp)
+	{
+		return -1;
+	}
+
+	// check if file has any strings
+	fseek(fp, 0L, SEEK_END);
+	long fileSize = ftell(fp);
+	fseek(fp, 0L, SEEK_SET);
+
+	// If app unexpectedly closed in middle of file write, this file 
+	// might be empty.
+	if (0 == fileSize)
+	{
+		fclose(fp);
+		return -1;
+	}
+
+	// read audio device entries from the file
+	wchar_t line[MAX_DEVICE_STRING_LENGTH];
+	while (fgetws(line, MAX_DEVICE_STRING_LENGTH, fp))
+	{
+		// strip off anything after newline
+		std::wstring s = line;				
+		std::wstring stripped = s.substr(0, s.find(L"\n"));
+
+		if (stripped.size())
+		{
+			toggleNames.push_back(stripped);
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+// ReadDeviceToggleStrings 
+// Open and read the contents of the config file and publish it as the 
+// device list
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	0	Success - the config file was read
+//	-1	The config file doesn't exist or is empty - the devices to toggle 
+//		need to be selected
+int ReadDeviceToggleStrings()
+{
+	std::vector<std::wstring> toggleNames;
+	if (0 != LoadDeviceToggleStrings(toggleNames))
 	{		
-		SelectDevicesDialog();
+		return -1;
 	}
-	else
+
+	std::shared_ptr<DeviceListSnapshot> deviceList = std::make_shared<DeviceListSnapshot>();
+	for (unsigned int i = 0; i < toggleNames.size(); i++)
 	{
-		// check if file has any strings
-		fseek(fp, 0L, SEEK_END);
-		long fileSize = ftell(fp);
-		fseek(fp, 0L, SEEK_SET);
-
-		// If app unexpectedly closed in middle of file write, this file 
-		// might be empty.  If file is empty, let user re-select audio devices
-		if (0 == fileSize)
+		deviceList->switchTable.Append(toggleNames[i]);
+	}
+	PublishDeviceList(deviceList);
+	return 0;
+}
+
+// ReloadDeviceToggleStrings 
+// Called when the config file was changed outside the app.  Reads and parses
+// it on a background worker, so a slow %APPDATA% (ie: a roaming profile on a
+// network share) can't stall the tray icon; OnConfigReloadResult applies it
+// once it is back.  A burst of changes is read once.
+//
+// Parameters:
+//	hWnd	Window handle of the tray icon
+//
+// Return values:
+//	none
+void ReloadDeviceToggleStrings(HWND hWnd)
+{
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"ConfigReload", 0, [hWnd]()
+	{
+		// a missing or empty file is most likely mid-write - wait for the next change
+		LONGLONG startTime = BackendTraceTimestamp();
+		std::vector<std::wstring> toggleNames;
+		if (0 != LoadDeviceToggleStrings(toggleNames))
+			return;
+
 		{
-			fclose(fp);
-			SelectDevicesDialog();
+			std::lock_guard<std::mutex> lock(g_ConfigReloadLock);
+			g_ConfigReloadPending = true;
+			g_ConfigReloadNames.swap(toggleNames);
+			g_ConfigReloadStartTime = startTime;
 		}
-		else
-		{			
-			// read audio device entries from the file
-			int index = 0;
-			wchar_t line[MAX_DEVICE_STRING_LENGTH];
-			while (fgetws(line, MAX_DEVICE_STRING_LENGTH, fp))
-			{
-				// strip off anything after newline
-				std::wstring s = line;				
-				std::wstring stripped = s.substr(0, s.find(L"\n"));
+		PostMessage(hWnd, WM_APP_CONFIG_RELOAD_EVENT, 0, 0);
+	});
+}
 
-				if (stripped.size())
-				{
-					g_EnumeratedDeviceList.push_back(stripped);
-					g_EnumeratedDeviceListSwitchIndexes.push_back(index);
-					index++;
-				}
-			}
+// OnConfigReloadResult 
+// Takes a background reload's toggle list on the UI thread and applies the
+// difference to the current one.  Entries that were already in the list keep
+// their availability; only new entries are checked, and only against the
+// devices found by the last enumeration.  The current device stays selected
+// if it is still in the list.
+//
+// Parameters:
+//	hWnd	Window handle of the tray icon
+//
+// Return values:
+//	none
+void OnConfigReloadResult(HWND hWnd)
+{
+	std::vector<std::wstring> toggleNames;
+	LONGLONG startTime;
+	{
+		std::lock_guard<std::mutex> lock(g_ConfigReloadLock);
+		if (!g_ConfigReloadPending)
+			return;
+		g_ConfigReloadPending = false;
+		toggleNames.swap(g_ConfigReloadNames);
+		startTime = g_ConfigReloadStartTime;
+	}
+
+	// nothing to do if the list didn't change (ie: the app just wrote it)
+	DeviceListSnapshotPtr oldList = AcquireDeviceList();
+	bool unchanged = ((int)toggleNames.size() == oldList->SwitchCount());
+	for (int i = 0; unchanged && (i < oldList->SwitchCount()); i++)
+	{
+		unchanged = (toggleNames[i] == oldList->SwitchName(i));
+	}
+	if (unchanged)
+		return;
+
+	std::shared_ptr<DeviceListSnapshot> newList = std::make_shared<DeviceListSnapshot>();
+	newList->activeTable = oldList->activeTable;
+	newList->activeDevicesEnumerated = oldList->activeDevicesEnumerated;
+	newList->availableMask = 0;
+	for (unsigned int i = 0; i < toggleNames.size(); i++)
+	{
+		newList->switchTable.Append(toggleNames[i]);
+	}
+
+	// new entries are checked against the last enumeration in one pass
+	CompileToggleList(*newList);
+	ULONGLONG activeMask = MatchActiveDevices(*newList);
+
+	int changedEntries = 0;
+	for (int i = 0; i < (int)toggleNames.size(); i++)
+	{
+		// carry over what is already known about entries that were in the old list
+		int oldIndex = -1;
+		for (int j = 0; (j < oldList->SwitchCount()) && (-1 == oldIndex); j++)
+		{
+			if (toggleNames[i] == oldList->SwitchName(j))
+				oldIndex = j;
 		}
-		fclose(fp);
+
+		bool available;
+		if (oldIndex >= 0)
+		{
+			available = IsSwitchIndexAvailable(*oldList, oldIndex);
+		}
+		else
+		{
+			available = (i < MAX_TRACKED_TOGGLE_DEVICES) && (0 != (activeMask & (1ULL << i)));
+			changedEntries++;
+		}
+
+		if (available && (i < MAX_TRACKED_TOGGLE_DEVICES))
+			newList->availableMask |= (1ULL << i);
+
+		if ((oldIndex >= 0) && (oldIndex == oldList->switchListIndex))
+			newList->switchListIndex = i;
 	}
+	PublishDeviceList(newList);
+	InvalidateAudioOutputDevicePrefetch();
+
+	WCHAR summary[128];
+	swprintf_s(summary, L"entries=%d changed=%d", newList->SwitchCount(), changedEntries);
+	TraceBackendCall(L"ConfigReload", startTime, S_OK, summary);
 
+	if (0 == newList->SwitchCount())
+		return;
+
+	if (newList->switchListIndex < 0)
+	{
+		// the current device was taken out of the list - move to the best one left
+		int bestIndex = BestAvailableSwitchIndex(*newList);
+		if ((bestIndex >= 0) && (0 == SetActiveAudioOutputDevice(bestIndex, false)))
+		{
+			SetCurrentSwitchIndex(bestIndex);
+			ChangeIcon(hWnd);
+		}
+	}
+	else
+	{
+		PostMessage(hWnd, WM_APP_PREFETCH_EVENT, 0, 0);
+	}
 }
 
 //	WriteDeviceToggleStrings 
 //	Writes out the current list of selected togglable audio devices to the 
-//	resource file.
+//	resource file.  The list is written to a temporary file first and moved 
+//	over the config file, so a reader never sees a half written list.  Runs 
+//	on the config writer thread - use RequestConfigWrite() to save the list.
 //
 // Parameters:
 //	none
@@ -216,29 +595,37 @@ void ReadDeviceToggleStrings()
 int WriteDeviceToggleStrings()
 {
 	int result = -1;
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
 
 	// If there are any selected devices to switch, save them
-	if (0!=g_EnumeratedDeviceListSwitchIndexes.size())
+	if (0!=deviceList->SwitchCount())
 	{	
 		// open and read the device id strings
 		FILE *fp = NULL;
 		
 		// open the resource file
 		std::string fullPathFilename;
-		int result = BuildResourceFilenameString(fullPathFilename);
-		if (0 == result)
+		if (0 == BuildResourceFilenameString(fullPathFilename, "AudioSources.cfg"))
 		{
-			result = fopen_s(&fp, fullPathFilename.c_str(), "w");
-			if (0 == result)
+			std::string tempFilename = fullPathFilename + ".tmp";
+			if (0 == fopen_s(&fp, tempFilename.c_str(), "w"))
 			{
 				// save the selected audio device strings to a file
-				for (unsigned int i = 0; i < g_EnumeratedDeviceListSwitchIndexes.size(); i++)
+				for (int i = 0; i < deviceList->SwitchCount(); i++)
 				{
-					fputws(g_EnumeratedDeviceList[g_EnumeratedDeviceListSwitchIndexes[i]].c_str(), fp);
+					fputws(deviceList->SwitchName(i), fp);
 					fputws(L"\n", fp);
 				}
-				fclose(fp);
-				result = 0;
+				bool written = !ferror(fp);
+				if ((0 == fclose(fp)) && written &&
+					MoveFileExA(tempFilename.c_str(), fullPathFilename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+				{
+					result = 0;
+				}
+				else
+				{
+					DeleteFileA(tempFilename.c_str());
+				}
 			}
 		}
 	}
@@ -259,8 +646,8 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 	int wmId, wmEvent;
 	PAINTSTRUCT ps;
 	HDC hdc;
-	int index = 0;
-	HMENU hMenu = nullptr;
+	DeviceListSnapshotPtr deviceList;
+	int nextIndex;
 
 	switch (message)
 	{
@@ -290,53 +677,71 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		{
 		// left double-click switches to the next audio device in the switch list
 		case WM_LBUTTONDBLCLK:			
-			if (g_EnumeratedDeviceListSwitchIndexes.size())
-			{
-				// go to next audio device index
-				g_DeviceSwitchListIndex = (g_DeviceSwitchListIndex + 1) % g_EnumeratedDeviceListSwitchIndexes.size();
-
-				// set the playback device
-				SetActiveAudioOutputDevice(g_DeviceSwitchListIndex);
-
-				// change the icon based on the device
-				ChangeIcon(hWnd);
-			}
+			OnTrayDoubleClick(hWnd, GetMessageTime());
 			break;
 
 		// right-click makes pop-up menu appear
 		case WM_RBUTTONDOWN:
-			hMenu = LoadMenu(g_hInstance, MAKEINTRESOURCE(IDR_POPUP));
-			if (hMenu)
-			{
-				HMENU hSubMenu = GetSubMenu(hMenu, 0);
-				if (hSubMenu)
-				{
-					// clear any/all items in the list
-					int menuItemCount = GetMenuItemCount(hSubMenu);
-					for (int i = 0; i < menuItemCount; i++)
-					{
-						DeleteMenu(hSubMenu, 0, MF_BYPOSITION);
-					}
+			OnTrayRightClick(hWnd);
+			break;
+		}
+		break;
 
-					// add all the selected/loaded items to the menu 
-					for (unsigned int i = 0; i < g_EnumeratedDeviceListSwitchIndexes.size(); i++)
-					{
-						AppendMenu(hSubMenu, MF_STRING, ID_ROOT_ITEM_0 + i, g_EnumeratedDeviceList[g_EnumeratedDeviceListSwitchIndexes[i]].c_str());
-					}
+	// resolve the next toggle target ahead of the next double-click
+	case WM_APP_PREFETCH_EVENT:
+		// warm the entry the next double-click will actually land on
+		deviceList = AcquireDeviceList();
+		nextIndex = NextAvailableSwitchIndex(*deviceList, deviceList->switchListIndex);
+		if (nextIndex >= 0)
+		{
+			PrefetchAudioOutputDevice(nextIndex);
+		}
+		ScheduleIdleTrim(hWnd);
+		break;
 
-					// add quit and re-select items to the list
-					AppendMenu(hSubMenu, MF_SEPARATOR, 0, L"");
-					AppendMenu(hSubMenu, MF_STRING, ID_ROOT_RESELECT, L"Re-select Devices");
-					AppendMenu(hSubMenu, MF_STRING, ID_ROOT_QUIT, L"Quit");
+	// a background readiness check finished
+	case WM_APP_READINESS_PROBE_EVENT:
+		OnReadinessProbeResult(hWnd);
+		break;
 
-					// track the popup menu
-					POINT stPoint;
-					GetCursorPos(&stPoint);
-					TrackPopupMenu(hSubMenu, TPM_LEFTALIGN | TPM_BOTTOMALIGN | TPM_RIGHTBUTTON, stPoint.x, stPoint.y, 0, hWnd, NULL);
-				}
-				DestroyMenu(hMenu);
-			}
-			break;
+	// a background device change rebuild finished
+	case WM_APP_DEVICE_REBUILD_EVENT:
+		OnDeviceRebuildResult(hWnd);
+		break;
+
+	// a background config file reload finished
+	case WM_APP_CONFIG_RELOAD_EVENT:
+		OnConfigReloadResult(hWnd);
+		break;
+
+	// a background prefetch resolve finished
+	case WM_APP_PREFETCH_RESOLVED_EVENT:
+		OnAudioOutputDevicePrefetched((UINT)wParam);
+		break;
+
+	// an audio endpoint was added, removed or changed state - wait for the
+	// rest of the burst before rebuilding
+	case WM_APP_DEVICE_CHANGE_EVENT:
+		ScheduleDeviceChangeRebuild(hWnd);
+		break;
+
+	case WM_TIMER:
+		if (IDT_DEVICE_CHANGE_TIMER == wParam)
+		{
+			// a device arriving while starting up may be what we're waiting for
+			LONG events = CompleteDeviceChangeRebuild(hWnd);
+			if (IsAudioReady())
+				OnAudioDevicesChanged(hWnd, events);
+			else
+				RunReadinessProbe(hWnd);
+		}
+		else if (IDT_READINESS_TIMER == wParam)
+		{
+			RunReadinessProbe(hWnd);
+		}
+		else if (IDT_IDLE_TRIM_TIMER == wParam)
+		{
+			EnterIdleMode(hWnd);
 		}
 		break;
 
@@ -344,52 +749,13 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		wmId = LOWORD(wParam);
 		wmEvent = HIWORD(wParam);
 		// Parse the menu selections:
-		switch (wmId)
-		{
-		// handle pop-up menu item 'quit'
-		case ID_ROOT_QUIT:
-			DestroyWindow(hWnd);
-			return 0;
-
-		// handle pop-up menu item 'reselect audio devices'
-		case ID_ROOT_RESELECT:
-			SelectDevicesDialog();
-			return 0;
-
-		// handle the pop-up menu device selections
-		case ID_ROOT_ITEM_0 + 0:
-		case ID_ROOT_ITEM_0 + 1:
-		case ID_ROOT_ITEM_0 + 2:
-		case ID_ROOT_ITEM_0 + 3:
-		case ID_ROOT_ITEM_0 + 4:
-		case ID_ROOT_ITEM_0 + 5:
-		case ID_ROOT_ITEM_0 + 6:
-		case ID_ROOT_ITEM_0 + 7:
-		case ID_ROOT_ITEM_0 + 8:
-		case ID_ROOT_ITEM_0 + 9:
-		case ID_ROOT_ITEM_0 + 10:
-		case ID_ROOT_ITEM_0 + 11:
-		case ID_ROOT_ITEM_0 + 12:
-		case ID_ROOT_ITEM_0 + 13:
-		case ID_ROOT_ITEM_0 + 14:
-		case ID_ROOT_ITEM_0 + 15:
-		case ID_ROOT_ITEM_0 + 16:
-		case ID_ROOT_ITEM_0 + 17:
-		case ID_ROOT_ITEM_0 + 18:
-		case ID_ROOT_ITEM_0 + 19:
-			g_DeviceSwitchListIndex = wmId - ID_ROOT_ITEM_0;
-			
-			// set the audio source to the selected item
-			SetActiveAudioOutputDevice(g_DeviceSwitchListIndex);
-			
-			// change the icon (if necessary)
-			ChangeIcon(hWnd);
-			return 0;
-			
-		default:
+		if (!OnTrayMenuCommand(hWnd, wmId, GetMessageTime()))
 			return DefWindowProc(hWnd, message, wParam, lParam);
-		}
-		break;
+		return 0;
+
+	// a second copy of the app was started - do what its command line asks
+	case WM_COPYDATA:
+		return OnForwardedCommandLine(hWnd, (const COPYDATASTRUCT*)lParam) ? TRUE : FALSE;
 
 	case WM_PAINT:
 		hdc = BeginPaint(hWnd, &ps);
@@ -397,6 +763,13 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		break;
 
 	case WM_DESTROY:
+		UnregisterDeviceNotifications();
+
+		// finish the last config write and whatever is already running while
+		// the enumerator is still there; the rest of the queue is dropped
+		StopBackgroundTasks(CONFIG_WRITE_TASK_KEY);
+		ReleaseAudioOutputDevicePrefetch();
+		ReleaseAudioDeviceEnumerator();
 		PostQuitMessage(0);
 		break;
 
@@ -420,24 +793,26 @@ int APIENTRY _tWinMain(_In_ HINSTANCE hInstance,
 	_In_ LPTSTR    lpCmdLine,
 	_In_ int       nCmdShow)
 {
-	// no command line parameters
 	UNREFERENCED_PARAMETER(hPrevInstance);
-	UNREFERENCED_PARAMETER(lpCmdLine);
+	LONG launchTime = (LONG)GetTickCount();
 	
-	// set up struct to create window class
-	WNDCLASS wcNotificationAreaClass;
-	ZeroMemory(&wcNotificationAreaClass, sizeof(wcNotificationAreaClass));
-	wcNotificationAreaClass.lpszClassName = _T("Taskbar_Sound_Switcher");
-
-	// find if window already exists   
-	g_hWnd = FindWindow(wcNotificationAreaClass.lpszClassName, NULL);
+	// find if window already exists - if so hand it our command line and 
+	// leave without loading anything
+	g_hWnd = FindWindow(_T("Taskbar_Sound_Switcher"), NULL);
 
 	if (g_hWnd)
 	{
-		PostMessage(g_hWnd, WM_APP_TRAY_EVENT, 0, WM_LBUTTONDBLCLK);
+		// older copies only know the double-click
+		if (1 == ForwardCommandLine(g_hWnd, lpCmdLine, launchTime))
+			PostMessage(g_hWnd, WM_APP_TRAY_EVENT, 0, WM_LBUTTONDBLCLK);
 	}
 	else
 	{
+		// set up struct to create window class
+		WNDCLASS wcNotificationAreaClass;
+		ZeroMemory(&wcNotificationAreaClass, sizeof(wcNotificationAreaClass));
+		wcNotificationAreaClass.lpszClassName = _T("Taskbar_Sound_Switcher");
+
 		// set up the window class register app
 		wcNotificationAreaClass.hInstance = hInstance;
 		wcNotificationAreaClass.lpfnWndProc = WndProc;
@@ -446,37 +821,99 @@ int APIENTRY _tWinMain(_In_ HINSTANCE hInstance,
 		if (classRC)
 		{
 			g_hInstance = hInstance;
+
+			// COM stays initialized on this thread for the life of the app
+			HRESULT hrInit = CoInitialize(NULL);
+
+			// let other programs read the current device without asking us
+			CreateStatusPublisher();
+
+			// background work (ie: saving config changes) runs on a few 
+			// shared worker threads
+			StartBackgroundTasks();
+
+			// /trace records every audio backend call to BackendTrace.log
+			if (lpCmdLine && _tcsstr(lpCmdLine, _T("/trace")))
+				StartBackendTrace();
+
+			// /nofailover keeps the current device selected when it is unplugged
+			if (lpCmdLine && _tcsstr(lpCmdLine, _T("/nofailover")))
+				g_FailoverEnabled = false;
+
+			// /movecommunications moves calls to the new device too instead
+			// of leaving them on the communications device
+			if (lpCmdLine && _tcsstr(lpCmdLine, _T("/movecommunications")))
+				g_MigrateCommunicationsRole = true;
+
+			// /lowfootprint releases cached audio objects and trims memory 
+			// while the app is idle
+			if (lpCmdLine && _tcsstr(lpCmdLine, _T("/lowfootprint")))
+				g_LowFootprintEnabled = true;
+
+			// /deadline:<ms> overrides how long a backend call may block
+			LPTSTR deadlineArg = lpCmdLine ? _tcsstr(lpCmdLine, _T("/deadline:")) : NULL;
+			if (deadlineArg && (_ttoi(deadlineArg + _tcslen(_T("/deadline:"))) > 0))
+				g_BackendDeadlineMs = _ttoi(deadlineArg + _tcslen(_T("/deadline:")));
+
 			if (g_hWnd = CreateWindow((LPCTSTR)classRC, _T(""), 0, 0, 0, 0, 0, NULL, NULL, hInstance, NULL))
 			{
-				// Get list of devices to toggle between either via dialog box 
-				// or via file
-				ReadDeviceToggleStrings();
-
-				// Figure out what the current audio device is and set the 
-				// the default/current playback device index if it's also  
-				// in the current device toggle list
-				DiscoverCurrentAudioOutputDevice(g_DeviceSwitchListIndex);
+				// Get list of devices to toggle between from the config file.
+				// Without one the devices are selected via dialog box once 
+				// they are up
+				if (0 != ReadDeviceToggleStrings())
+					g_SelectDevicesWhenReady = true;
 
-				// Set the audio output to one of the devices in the 
-				// selected list
-				SetActiveAudioOutputDevice(g_DeviceSwitchListIndex);
+				// Keep track of the devices as they come and go
+				RegisterDeviceNotifications(g_hWnd);
+				TraceResourceUsage(L"Startup");
 
-				// Change the icon to match the playback device
-				ChangeIcon(g_hWnd);
+				// At logon the audio service and USB devices may not be up 
+				// yet - wait for them before picking and setting the device
+				StartReadinessProbe(g_hWnd);
 
+				// watch the config file so edits to it apply without a restart
+				HANDLE hConfigChanged = StartConfigWatch();
 
 				// handle the message loop
 				MSG Msg;
-				while (GetMessage(&Msg, NULL, 0, 0) > 0)
+				bool running = true;
+				while (running)
 				{
-					TranslateMessage(&Msg);
-					DispatchMessage(&Msg);
+					DWORD waitResult = MsgWaitForMultipleObjects(hConfigChanged ? 1 : 0, &hConfigChanged, FALSE, INFINITE, QS_ALLINPUT);
+					if (hConfigChanged && (WAIT_OBJECT_0 == waitResult))
+					{
+						if (ConfigFileChanged())
+							ReloadDeviceToggleStrings(g_hWnd);
+						continue;
+					}
+
+					while (PeekMessage(&Msg, NULL, 0, 0, PM_REMOVE))
+					{
+						if (WM_QUIT == Msg.message)
+						{
+							running = false;
+							break;
+						}
+						TranslateMessage(&Msg);
+						DispatchMessage(&Msg);
+					}
 				}
+				StopConfigWatch();
 
 				if (IsWindow(g_hWnd))
 					DestroyWindow(g_hWnd);
 			}
 			UnregisterClass((LPCTSTR)classRC, g_hInstance);
+
+			// the workers were stopped by WM_DESTROY unless the window never 
+			// came up
+			StopBackgroundTasks(CONFIG_WRITE_TASK_KEY);
+			TraceResourceUsage(L"Exit");
+			TraceSwitchTimingSummary();
+			StopBackendTrace();
+			DestroyStatusPublisher();
+			if (SUCCEEDED(hrInit))
+				CoUninitialize();
 		}
 	}
 
@@ -15,21 +15,33 @@
 #define MAX_LOADSTRING 100
 #define MAX_DEVICE_STRING_LENGTH 4096
 extern const UINT WM_APP_TRAY_EVENT;
+extern const UINT WM_APP_PREFETCH_EVENT;
+extern const UINT WM_APP_DEVICE_CHANGE_EVENT;
+extern const UINT WM_APP_PREFETCH_RESOLVED_EVENT;
+extern const UINT WM_APP_READINESS_PROBE_EVENT;
+extern const UINT WM_APP_DEVICE_REBUILD_EVENT;
+extern const UINT WM_APP_CONFIG_RELOAD_EVENT;
 extern HWND g_hWnd;									// app window
 extern HINSTANCE g_hInstance;						// app instance
 extern HICON g_hSpeakerIcon;						// tray icon
 extern HICON g_hHeadphonesIcon;						// tray icon
 
 // Global variables					
-extern int	g_DeviceSwitchListIndex;							// the index of the current output device
-extern std::vector<std::wstring> g_EnumeratedDeviceList;		// list of all devices (strings)
-extern std::vector<int> g_EnumeratedDeviceListSwitchIndexes;	// list of indexes into the device list 
+extern bool g_FailoverEnabled;									// switch to the best available entry when the current one goes away
 
 // function definitions
 BOOL InitInstance(HINSTANCE, int);
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 void LoadStringSafe(UINT nStrID, LPTSTR szBuf, UINT nBufLen);	
+int BuildResourceFilenameString(std::string& fullPathFilename, const char* filename);
 int	 ChangeIcon(HWND hWnd);
-void ReadDeviceToggleStrings();
+void ShowTrayNotice(LPCWSTR title, LPCWSTR text);
+void OnAudioReady(HWND hWnd, HRESULT hrEnumerate, const std::vector<std::wstring>& deviceIds, const std::vector<std::wstring>& deviceNames);
+void OnAudioDevicesChanged(HWND hWnd, LONG events);
+void OnDeviceRebuildResult(HWND hWnd);
+int LoadDeviceToggleStrings(std::vector<std::wstring>& toggleNames);
+int ReadDeviceToggleStrings();
+void ReloadDeviceToggleStrings(HWND hWnd);
+void OnConfigReloadResult(HWND hWnd);
 int WriteDeviceToggleStrings();
 
@@ -0,0 +1,169 @@
+// ----------------------------------------------------------------------------
+// readinessprobe.cpp
+// Waits for the audio service and devices to come up after logon before the
+// app resolves and sets its device
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "main.h"
+#include "readinessprobe.h"
+#include "devicediscovery.h"
+#include "devicelist.h"
+#include "devicenotify.h"
+#include "backendtrace.h"
+#include "backgroundtasks.h"
+
+#include <mutex>
+
+// probe state - only touched on the UI thread
+static bool			g_AudioReady = false;
+static bool			g_ProbeInFlight = false;
+static bool			g_ProbeRerun = false;
+static ULONGLONG	g_ProbeStartTick = 0;
+static LONGLONG		g_ProbeTraceStart = 0;
+static DWORD		g_ProbeDelayMs = READINESS_PROBE_FIRST_DELAY_MS;
+static unsigned int	g_ProbeAttempts = 0;
+
+// the enumeration a background worker made for the last probe
+static std::mutex					g_ProbeResultLock;
+static HRESULT						g_ProbeResultHr = E_FAIL;
+static std::vector<std::wstring>	g_ProbeResultIds;
+static std::vector<std::wstring>	g_ProbeResultNames;
+
+
+// StartReadinessProbe
+// Starts waiting for the audio devices.  The first check is made right away;
+// OnAudioReady is called as soon as one passes.
+//
+// Parameters:
+//	hWnd	Window handle of the tray icon, receives the probe's WM_TIMER
+//
+// Return values:
+//	none
+void StartReadinessProbe(HWND hWnd)
+{
+	g_AudioReady = false;
+	g_ProbeStartTick = GetTickCount64();
+	g_ProbeTraceStart = BackendTraceTimestamp();
+	g_ProbeDelayMs = READINESS_PROBE_FIRST_DELAY_MS;
+	g_ProbeAttempts = 0;
+
+	RunReadinessProbe(hWnd);
+}
+
+// RunReadinessProbe
+// Starts one check of whether the audio devices are up.  Called when the
+// backoff timer fires and whenever a device arrives before the app is ready.
+// The enumeration runs on a background worker, which posts
+// WM_APP_READINESS_PROBE_EVENT when it is done.
+//
+// Parameters:
+//	hWnd	Window handle of the tray icon
+//
+// Return values:
+//	none
+void RunReadinessProbe(HWND hWnd)
+{
+	if (g_AudioReady)
+		return;
+
+	// a device arrived mid-probe - check again as soon as this one is back
+	if (g_ProbeInFlight)
+	{
+		g_ProbeRerun = true;
+		return;
+	}
+
+	KillTimer(hWnd, IDT_READINESS_TIMER);
+	g_ProbeAttempts++;
+	g_ProbeInFlight = true;
+	g_ProbeRerun = false;
+
+	// the notification callback may not have registered if the service was down
+	RegisterDeviceNotifications(hWnd);
+
+	QueueBackgroundTask(TASK_PRIORITY_HIGH, L"ReadinessProbe", 0, [hWnd]()
+	{
+		std::vector<std::wstring> deviceIds;
+		std::vector<std::wstring> deviceNames;
+		HRESULT hr = EnumerateAudioOutputDevices(deviceIds, deviceNames);
+		{
+			std::lock_guard<std::mutex> lock(g_ProbeResultLock);
+			g_ProbeResultHr = hr;
+			g_ProbeResultIds.swap(deviceIds);
+			g_ProbeResultNames.swap(deviceNames);
+		}
+		PostMessage(hWnd, WM_APP_READINESS_PROBE_EVENT, 0, 0);
+	});
+}
+
+// OnReadinessProbeResult
+// Takes a probe's enumeration on the UI thread.  The audio is ready once
+// enumeration returns devices and, if there is a toggle list, one of them
+// matches it.  The enumeration is handed on to OnAudioReady so it doesn't
+// have to enumerate again.
+//
+// Parameters:
+//	hWnd	Window handle of the tray icon
+//
+// Return values:
+//	none
+void OnReadinessProbeResult(HWND hWnd)
+{
+	if (g_AudioReady || !g_ProbeInFlight)
+		return;
+	g_ProbeInFlight = false;
+
+	std::vector<std::wstring> deviceIds;
+	std::vector<std::wstring> deviceNames;
+	HRESULT hr;
+	{
+		std::lock_guard<std::mutex> lock(g_ProbeResultLock);
+		hr = g_ProbeResultHr;
+		deviceIds.swap(g_ProbeResultIds);
+		deviceNames.swap(g_ProbeResultNames);
+	}
+	bool ready = SUCCEEDED(hr) && !deviceNames.empty();
+
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if (ready && deviceList->SwitchCount() && deviceList->matcher)
+	{
+		ready = false;
+		for (unsigned int i = 0; (i < deviceNames.size()) && !ready; i++)
+		{
+			ready = (deviceList->matcher->FirstMatch(deviceNames[i]) >= 0);
+		}
+	}
+
+	bool givenUp = (GetTickCount64() - g_ProbeStartTick >= READINESS_PROBE_GIVE_UP_MS);
+	if (!ready && !givenUp)
+	{
+		if (g_ProbeRerun)
+		{
+			RunReadinessProbe(hWnd);
+			return;
+		}
+
+		// try again later, or sooner if a device arrives
+		SetTimer(hWnd, IDT_READINESS_TIMER, g_ProbeDelayMs, NULL);
+		g_ProbeDelayMs = (g_ProbeDelayMs * 2 < READINESS_PROBE_MAX_DELAY_MS) ? g_ProbeDelayMs * 2 : READINESS_PROBE_MAX_DELAY_MS;
+		return;
+	}
+
+	g_AudioReady = true;
+
+	// the elapsed time of this line is the time to ready
+	WCHAR summary[128];
+	swprintf_s(summary, L"attempts=%u devices=%u gave_up=%d", g_ProbeAttempts, (unsigned int)deviceNames.size(), givenUp ? 1 : 0);
+	TraceBackendCall(L"AudioReady", g_ProbeTraceStart, hr, summary);
+
+	OnAudioReady(hWnd, hr, deviceIds, deviceNames);
+}
+
+// IsAudioReady
+// Returns true once the readiness probe passed (or gave up)
+bool IsAudioReady()
+{
+	return g_AudioReady;
+}
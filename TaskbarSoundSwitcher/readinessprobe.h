@@ -0,0 +1,23 @@
+// ----------------------------------------------------------------------------
+// readinessprobe.h
+// Waits for the audio service and devices to come up after logon before the
+// app resolves and sets its device
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+// the probe retries after READINESS_PROBE_FIRST_DELAY_MS, doubling the delay
+// up to READINESS_PROBE_MAX_DELAY_MS, and goes with whatever devices there are
+// once READINESS_PROBE_GIVE_UP_MS have passed
+#define READINESS_PROBE_FIRST_DELAY_MS	100
+#define READINESS_PROBE_MAX_DELAY_MS	5000
+#define READINESS_PROBE_GIVE_UP_MS		60000
+#define IDT_READINESS_TIMER				2
+
+// Routines used to wait for the audio devices at startup
+void StartReadinessProbe(HWND hWnd);
+void RunReadinessProbe(HWND hWnd);
+void OnReadinessProbeResult(HWND hWnd);
+bool IsAudioReady();
@@ -0,0 +1,104 @@
+// ----------------------------------------------------------------------------
+// statusblock.h
+// Layout of the shared memory status block the app publishes, and a header
+// only reader for other programs (stream deck plugins, status bar widgets)
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include <windows.h>
+
+// name of the file mapping and the layout version stored in the block
+#define STATUS_BLOCK_NAME			L"Local\\TaskbarSoundSwitcherStatus"
+#define STATUS_BLOCK_VERSION		1
+
+// toggle list entries published, and the longest name stored for each
+#define STATUS_BLOCK_MAX_DEVICES	32
+#define STATUS_BLOCK_MAX_NAME		128
+
+// icon shown for a device
+#define DEVICE_ICON_SPEAKERS		0
+#define DEVICE_ICON_HEADPHONES		1
+
+// StatusBlock
+// The app's current state.  It is protected by a seqlock: the app makes
+// sequence odd, updates the block and makes it even again.  Readers copy the
+// block and retry if sequence was odd or changed while they copied.
+struct StatusBlock
+{
+	volatile LONG	sequence;				// odd while the app is updating the block
+	DWORD			version;				// STATUS_BLOCK_VERSION
+	ULONGLONG		generation;				// bumped every time the app's state changes
+	LONG			currentIndex;			// toggle list index of the current device, -1 if unknown
+	LONG			iconClass;				// DEVICE_ICON_xxx of the current device
+	LONG			toggleCount;			// entries in the toggle list (may exceed STATUS_BLOCK_MAX_DEVICES)
+	ULONGLONG		availableMask;			// bit per toggle list entry, set if the device is plugged in
+	WCHAR			deviceNames[STATUS_BLOCK_MAX_DEVICES][STATUS_BLOCK_MAX_NAME];
+};
+
+// OpenStatusBlock
+// Maps the app's status block for reading
+//
+// Parameters:
+//	ppBlock		Set to the mapped block
+//
+// Return values:
+//	Mapping handle to pass to CloseStatusBlock, or NULL if the app isn't running
+inline HANDLE OpenStatusBlock(const StatusBlock** ppBlock)
+{
+	*ppBlock = NULL;
+	HANDLE hMapping = OpenFileMappingW(FILE_MAP_READ, FALSE, STATUS_BLOCK_NAME);
+	if (!hMapping)
+		return NULL;
+
+	*ppBlock = (const StatusBlock*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, sizeof(StatusBlock));
+	if (!*ppBlock)
+	{
+		CloseHandle(hMapping);
+		return NULL;
+	}
+	return hMapping;
+}
+
+// ReadStatusBlock
+// Takes a consistent copy of the status block without any locks or calls into
+// the app.  Readers polling for changes can compare generation first.
+//
+// Parameters:
+//	pBlock		Block returned by OpenStatusBlock
+//	pCopy		Receives the copy
+//	maxTries	How many times to retry while the app is updating the block
+//
+// Return values:
+//	true	pCopy holds a consistent copy
+//	false	The block kept changing, or has a different layout version
+inline bool ReadStatusBlock(const StatusBlock* pBlock, StatusBlock* pCopy, int maxTries)
+{
+	for (int i = 0; i < maxTries; i++)
+	{
+		LONG before = pBlock->sequence;
+		if (before & 1)
+		{
+			YieldProcessor();
+			continue;
+		}
+
+		MemoryBarrier();
+		CopyMemory(pCopy, (const void*)pBlock, sizeof(StatusBlock));
+		MemoryBarrier();
+
+		if (before == pBlock->sequence)
+			return STATUS_BLOCK_VERSION == pCopy->version;
+	}
+	return false;
+}
+
+// CloseStatusBlock
+// Unmaps a block opened with OpenStatusBlock
+inline void CloseStatusBlock(HANDLE hMapping, const StatusBlock* pBlock)
+{
+	if (pBlock)
+		UnmapViewOfFile(pBlock);
+	if (hMapping)
+		CloseHandle(hMapping);
+}
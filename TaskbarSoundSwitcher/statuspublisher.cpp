@@ -0,0 +1,103 @@
+// ----------------------------------------------------------------------------
+// statuspublisher.cpp
+// Mirrors the app's device state into the shared memory status block
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "main.h"
+#include "statuspublisher.h"
+#include "statusblock.h"
+
+// the app's side of the status block
+static HANDLE		g_hStatusMapping = NULL;
+static StatusBlock*	g_pStatusBlock = nullptr;
+
+
+// CreateStatusPublisher
+// Creates the named status block other programs can read with statusblock.h
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	0	Success - the block exists and is updated from now on
+//	-1	Failure - the app runs without publishing its status
+int CreateStatusPublisher()
+{
+	g_hStatusMapping = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(StatusBlock), STATUS_BLOCK_NAME);
+	if (!g_hStatusMapping)
+		return -1;
+
+	g_pStatusBlock = (StatusBlock*)MapViewOfFile(g_hStatusMapping, FILE_MAP_WRITE, 0, 0, sizeof(StatusBlock));
+	if (!g_pStatusBlock)
+	{
+		CloseHandle(g_hStatusMapping);
+		g_hStatusMapping = NULL;
+		return -1;
+	}
+
+	ZeroMemory(g_pStatusBlock, sizeof(StatusBlock));
+	g_pStatusBlock->version = STATUS_BLOCK_VERSION;
+	g_pStatusBlock->currentIndex = -1;
+	return 0;
+}
+
+// PublishStatusBlock
+// Copies a device list snapshot into the status block.  Only one thread may
+// call this at a time - devicelist.cpp calls it while holding its writer lock.
+//
+// Parameters:
+//	deviceList	The snapshot that was just published
+//
+// Return values:
+//	none
+void PublishStatusBlock(const DeviceListSnapshot& deviceList)
+{
+	if (!g_pStatusBlock)
+		return;
+
+	// odd - readers retry until the update is done
+	InterlockedIncrement(&g_pStatusBlock->sequence);
+
+	int current = deviceList.switchListIndex;
+	bool currentValid = (current >= 0) && (current < deviceList.SwitchCount());
+
+	g_pStatusBlock->generation++;
+	g_pStatusBlock->currentIndex = currentValid ? current : -1;
+	g_pStatusBlock->iconClass = currentValid ? deviceList.SwitchIconClass(current) : DEVICE_ICON_SPEAKERS;
+	g_pStatusBlock->toggleCount = deviceList.SwitchCount();
+	g_pStatusBlock->availableMask = deviceList.availableMask;
+	for (int i = 0; i < STATUS_BLOCK_MAX_DEVICES; i++)
+	{
+		if (i < deviceList.SwitchCount())
+			wcsncpy_s(g_pStatusBlock->deviceNames[i], deviceList.SwitchName(i), _TRUNCATE);
+		else
+			g_pStatusBlock->deviceNames[i][0] = 0;
+	}
+
+	// even again - the block is consistent
+	InterlockedIncrement(&g_pStatusBlock->sequence);
+}
+
+// DestroyStatusPublisher
+// Removes the status block on exit
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void DestroyStatusPublisher()
+{
+	if (g_pStatusBlock)
+	{
+		UnmapViewOfFile(g_pStatusBlock);
+		g_pStatusBlock = nullptr;
+	}
+	if (g_hStatusMapping)
+	{
+		CloseHandle(g_hStatusMapping);
+		g_hStatusMapping = NULL;
+	}
+}
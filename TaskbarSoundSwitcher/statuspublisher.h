@@ -0,0 +1,14 @@
+// ----------------------------------------------------------------------------
+// statuspublisher.h
+// Mirrors the app's device state into the shared memory status block
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include "devicelist.h"
+
+// Routines used to create, update and remove the status block
+int CreateStatusPublisher();
+void PublishStatusBlock(const DeviceListSnapshot& deviceList);
+void DestroyStatusPublisher();
@@ -0,0 +1,129 @@
+// ----------------------------------------------------------------------------
+// switchtiming.cpp
+// Per-phase timing of device switches, summarized in the /trace log on exit
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "switchtiming.h"
+#include "backendtrace.h"
+
+#include <algorithm>
+#include <vector>
+
+// reservoir of elapsed times for each phase, in microseconds, and how many
+// times each phase was recorded in all
+static std::vector<double>	g_SwitchPhaseSamples[SWITCH_PHASE_COUNT];
+static unsigned int			g_SwitchPhaseCounts[SWITCH_PHASE_COUNT];
+static unsigned int			g_ReservoirRandom = 2463534242;
+
+// names used for each phase in the trace log
+static const LPCWSTR g_SwitchPhaseNames[SWITCH_PHASE_COUNT] =
+{
+	L"advance",
+	L"resolve",
+	L"set_default",
+	L"icon",
+	L"total",
+	L"input_to_icon"
+};
+
+
+// AddSwitchSample
+// Adds one elapsed time to a phase's reservoir.  Once the reservoir is full
+// each new sample replaces a random one with probability max/count, which
+// keeps every sample recorded so far equally likely to be in it.
+static void AddSwitchSample(SwitchPhase phase, double elapsedUs)
+{
+	unsigned int count = ++g_SwitchPhaseCounts[phase];
+	if (g_SwitchPhaseSamples[phase].size() < SWITCH_TIMING_MAX_SAMPLES)
+	{
+		g_SwitchPhaseSamples[phase].push_back(elapsedUs);
+		return;
+	}
+
+	// xorshift32
+	g_ReservoirRandom ^= g_ReservoirRandom << 13;
+	g_ReservoirRandom ^= g_ReservoirRandom >> 17;
+	g_ReservoirRandom ^= g_ReservoirRandom << 5;
+	unsigned int slot = g_ReservoirRandom % count;
+	if (slot < SWITCH_TIMING_MAX_SAMPLES)
+		g_SwitchPhaseSamples[phase][slot] = elapsedUs;
+}
+
+// RecordSwitchPhase
+// Records how long one phase of a switch took.  Does nothing unless the app
+// was started with /trace.
+//
+// Parameters:
+//	phase		The phase that just finished
+//	startTime	Value BackendTraceTimestamp() returned when the phase started
+//
+// Return values:
+//	none
+void RecordSwitchPhase(SwitchPhase phase, LONGLONG startTime)
+{
+	if (!IsBackendTraceEnabled())
+		return;
+
+	AddSwitchSample(phase, BackendTraceElapsedUs(startTime));
+}
+
+// RecordSwitchInputLatency
+// Records the time from the input message that asked for a switch being
+// posted until now, when its icon has been updated.  This includes however
+// long the message waited in the queue.  Message times only have
+// millisecond resolution.  Does nothing unless the app was started with /trace.
+//
+// Parameters:
+//	inputTime	GetMessageTime() of the input message
+//
+// Return values:
+//	none
+void RecordSwitchInputLatency(LONG inputTime)
+{
+	if (!IsBackendTraceEnabled())
+		return;
+
+	// message times wrap with the tick count, so compare in 32 bits
+	DWORD elapsedMs = GetTickCount() - (DWORD)inputTime;
+	AddSwitchSample(SWITCH_PHASE_INPUT, (double)elapsedMs * 1000.0);
+}
+
+// Percentile
+// Returns the sample below which the given fraction of a sorted list falls
+static double Percentile(const std::vector<double>& sorted, double fraction)
+{
+	size_t index = (size_t)(fraction * (double)(sorted.size() - 1) + 0.5);
+	return sorted[index];
+}
+
+// TraceSwitchTimingSummary
+// Writes the count, median, tail latencies and maximum of every switch phase
+// to the trace log.  Called once on exit.  Past SWITCH_TIMING_MAX_SAMPLES
+// switches the percentiles and maximum come from the sampled reservoir.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void TraceSwitchTimingSummary()
+{
+	if (!IsBackendTraceEnabled())
+		return;
+
+	for (int phase = 0; phase < SWITCH_PHASE_COUNT; phase++)
+	{
+		std::vector<double> sorted = g_SwitchPhaseSamples[phase];
+		if (sorted.empty())
+			continue;
+		std::sort(sorted.begin(), sorted.end());
+
+		WCHAR summary[256];
+		swprintf_s(summary, L"phase=%s count=%u p50_us=%.1f p95_us=%.1f p99_us=%.1f max_us=%.1f",
+			g_SwitchPhaseNames[phase], g_SwitchPhaseCounts[phase],
+			Percentile(sorted, 0.50), Percentile(sorted, 0.95), Percentile(sorted, 0.99), sorted.back());
+		TraceBackendCall(L"SwitchTimingSummary", BackendTraceTimestamp(), S_OK, summary);
+	}
+}
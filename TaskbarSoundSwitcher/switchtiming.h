@@ -0,0 +1,29 @@
+// ----------------------------------------------------------------------------
+// switchtiming.h
+// Per-phase timing of device switches, summarized in the /trace log on exit
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+
+// samples kept per phase.  Past this a uniform sample of all the switches
+// is kept, so a long running trace holds its memory steady.
+#define SWITCH_TIMING_MAX_SAMPLES		4096
+
+// the phases of one switch
+enum SwitchPhase
+{
+	SWITCH_PHASE_ADVANCE,			// picking the next available toggle list entry
+	SWITCH_PHASE_RESOLVE,			// finding the entry's endpoint id
+	SWITCH_PHASE_SET_DEFAULT,		// making the endpoint the default device
+	SWITCH_PHASE_ICON,				// classifying the device and updating the tray icon
+	SWITCH_PHASE_TOTAL,				// the whole switch, from the handler starting to the new icon
+	SWITCH_PHASE_INPUT,				// from the click being posted to the new icon (ms resolution)
+	SWITCH_PHASE_COUNT
+};
+
+// Routines used to time switches while tracing
+void RecordSwitchPhase(SwitchPhase phase, LONGLONG startTime);
+void RecordSwitchInputLatency(LONG inputTime);
+void TraceSwitchTimingSummary();
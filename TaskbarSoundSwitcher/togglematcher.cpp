@@ -0,0 +1,199 @@
+// ----------------------------------------------------------------------------
+// togglematcher.cpp
+// Matches device names against all of the toggle list entries at once
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "togglematcher.h"
+
+
+// ToggleMatcher
+// Compiles the toggle list entries.  A state of the automaton is a position
+// in one entry's tokens; matching tracks every live position of every entry.
+//
+// Parameters:
+//	entries		The toggle list entries, in toggle list order
+ToggleMatcher::ToggleMatcher(const std::vector<std::wstring>& entries)
+{
+	for (unsigned int i = 0; i < entries.size(); i++)
+	{
+		const std::wstring& entry = entries[i];
+		bool isPattern = (std::wstring::npos != entry.find_first_of(L"*?"));
+
+		m_startStates.push_back((int)m_tokens.size());
+
+		// a plain entry can appear anywhere in the name
+		if (!isPattern)
+			AddToken(TOKEN_ANY_RUN, 0);
+
+		for (unsigned int j = 0; j < entry.size(); j++)
+		{
+			if (isPattern && (L'*' == entry[j]))
+				AddToken(TOKEN_ANY_RUN, 0);
+			else if (isPattern && (L'?' == entry[j]))
+				AddToken(TOKEN_ANY_CHAR, 0);
+			else
+				AddToken(TOKEN_LITERAL, entry[j]);
+		}
+
+		if (!isPattern)
+			AddToken(TOKEN_ANY_RUN, 0);
+
+		m_acceptStates.push_back((int)m_tokens.size());
+		AddToken(TOKEN_END, 0);
+	}
+}
+
+// AddToken
+// Appends one token to the automaton
+void ToggleMatcher::AddToken(TokenKind kind, wchar_t ch)
+{
+	Token token;
+	token.kind = kind;
+	token.ch = ch;
+	m_tokens.push_back(token);
+}
+
+// FollowAnyRuns
+// A '*' can match nothing, so a position in front of one is also a position
+// after it.  Positions only move forward, so one pass in order covers runs
+// of several '*'s.
+void ToggleMatcher::FollowAnyRuns(std::vector<char>& states) const
+{
+	for (unsigned int i = 0; i < m_tokens.size(); i++)
+	{
+		if (states[i] && (TOKEN_ANY_RUN == m_tokens[i].kind))
+			states[i + 1] = 1;
+	}
+}
+
+// Run
+// Runs a device name through every entry at once
+//
+// Parameters:
+//	name		The device's friendly name
+//	states		Set to the live positions once the whole name was consumed
+//
+// Return values:
+//	none
+void ToggleMatcher::Run(const std::wstring& name, std::vector<char>& states) const
+{
+	states.assign(m_tokens.size(), 0);
+	for (unsigned int i = 0; i < m_startStates.size(); i++)
+	{
+		states[m_startStates[i]] = 1;
+	}
+	FollowAnyRuns(states);
+
+	std::vector<char> next(m_tokens.size(), 0);
+	for (unsigned int c = 0; c < name.size(); c++)
+	{
+		bool anyLive = false;
+		next.assign(m_tokens.size(), 0);
+		for (unsigned int i = 0; i < m_tokens.size(); i++)
+		{
+			if (!states[i])
+				continue;
+
+			switch (m_tokens[i].kind)
+			{
+			case TOKEN_LITERAL:
+				if (m_tokens[i].ch == name[c])
+				{
+					next[i + 1] = 1;
+					anyLive = true;
+				}
+				break;
+			case TOKEN_ANY_CHAR:
+				next[i + 1] = 1;
+				anyLive = true;
+				break;
+			case TOKEN_ANY_RUN:
+				next[i] = 1;
+				anyLive = true;
+				break;
+			case TOKEN_END:
+				break;
+			}
+		}
+		FollowAnyRuns(next);
+		states.swap(next);
+
+		// no entry can match any more
+		if (!anyLive)
+			break;
+	}
+}
+
+// EntryCount
+// Returns the number of compiled entries
+int ToggleMatcher::EntryCount() const
+{
+	return (int)m_startStates.size();
+}
+
+// Match
+// Marks every entry the device name matches
+//
+// Parameters:
+//	name		The device's friendly name
+//	matched		One flag per entry.  Flags of matching entries are set, the
+//				others are left alone so several names can be combined.
+//
+// Return values:
+//	none
+void ToggleMatcher::Match(const std::wstring& name, std::vector<bool>& matched) const
+{
+	std::vector<char> states;
+	Run(name, states);
+
+	matched.resize(m_acceptStates.size(), false);
+	for (unsigned int i = 0; i < m_acceptStates.size(); i++)
+	{
+		if (states[m_acceptStates[i]])
+			matched[i] = true;
+	}
+}
+
+// FirstMatch
+// Finds the first entry in toggle list order that the device name matches
+//
+// Parameters:
+//	name		The device's friendly name
+//
+// Return values:
+//	>=0		Index of the first matching entry
+//	-1		No entry matches the name
+int ToggleMatcher::FirstMatch(const std::wstring& name) const
+{
+	std::vector<char> states;
+	Run(name, states);
+
+	for (unsigned int i = 0; i < m_acceptStates.size(); i++)
+	{
+		if (states[m_acceptStates[i]])
+			return (int)i;
+	}
+	return -1;
+}
+
+// Matches
+// Checks the device name against one entry
+//
+// Parameters:
+//	name		The device's friendly name
+//	entry		Index of the toggle list entry
+//
+// Return values:
+//	true	The name matches the entry
+//	false	It doesn't, or entry is out of range
+bool ToggleMatcher::Matches(const std::wstring& name, int entry) const
+{
+	if ((entry < 0) || (entry >= EntryCount()))
+		return false;
+
+	std::vector<char> states;
+	Run(name, states);
+	return 0 != states[m_acceptStates[entry]];
+}
@@ -0,0 +1,43 @@
+// ----------------------------------------------------------------------------
+// togglematcher.h
+// Matches device names against all of the toggle list entries at once
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <string>
+#include <vector>
+
+// ToggleMatcher
+// The toggle list entries compiled into one automaton.  An entry containing
+// '*' (any run of characters) or '?' (any one character) is a pattern that
+// must match the whole device name, ie: "Speakers (*- Dock Audio)".  Any other
+// entry matches a device whose name contains it, as entries always have.
+// Each device name is run through every entry in a single pass.
+class ToggleMatcher
+{
+public:
+	ToggleMatcher(const std::vector<std::wstring>& entries);
+
+	int EntryCount() const;
+	void Match(const std::wstring& name, std::vector<bool>& matched) const;
+	int FirstMatch(const std::wstring& name) const;
+	bool Matches(const std::wstring& name, int entry) const;
+
+private:
+	enum TokenKind { TOKEN_LITERAL, TOKEN_ANY_CHAR, TOKEN_ANY_RUN, TOKEN_END };
+	struct Token
+	{
+		TokenKind kind;
+		wchar_t ch;
+	};
+
+	void AddToken(TokenKind kind, wchar_t ch);
+	void FollowAnyRuns(std::vector<char>& states) const;
+	void Run(const std::wstring& name, std::vector<char>& states) const;
+
+	std::vector<Token> m_tokens;		// every entry's tokens back to back, each ending in TOKEN_END
+	std::vector<int> m_startStates;		// first token of each entry
+	std::vector<int> m_acceptStates;	// TOKEN_END of each entry - reached when the entry matched
+};
@@ -0,0 +1,139 @@
+// ----------------------------------------------------------------------------
+// trayevents.cpp
+// Handlers for the tray icon's clicks and pop-up menu commands
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "resource.h"
+#include "trayevents.h"
+#include "devicelist.h"
+#include "deviceavailability.h"
+#include "backendtrace.h"
+#include "switchtiming.h"
+
+
+// TrayEventHandler
+// Binds the handlers to the backend they switch through and the view they
+// report to.  Both must outlive the handler.
+//
+// Parameters:
+//	backend		The audio backend
+//	view		The tray icon and window
+TrayEventHandler::TrayEventHandler(ITrayDeviceBackend& backend, ITrayView& view) :
+	m_backend(backend),
+	m_view(view)
+{
+}
+
+// SwitchToDevice
+// Sets the toggle list entry as the playback device and updates the icon if
+// it worked, recording the switch's timing
+//
+// Parameters:
+//	index		The index in the device list's switch list to switch to
+//	switchStart	Value BackendTraceTimestamp() returned when the handler started
+//	inputTime	GetMessageTime() of the input message that asked for the switch
+//
+// Return values:
+//	0	Success - device set and icon changed
+//	-1	Failure - the device could not be set
+int TrayEventHandler::SwitchToDevice(int index, LONGLONG switchStart, LONG inputTime)
+{
+	if (0 != m_backend.SetActiveDevice(index, true))
+		return -1;
+
+	SetCurrentSwitchIndex(index);
+
+	// change the icon (if necessary)
+	LONGLONG phaseStart = BackendTraceTimestamp();
+	m_view.UpdateIcon();
+	RecordSwitchPhase(SWITCH_PHASE_ICON, phaseStart);
+	RecordSwitchPhase(SWITCH_PHASE_TOTAL, switchStart);
+	RecordSwitchInputLatency(inputTime);
+	return 0;
+}
+
+// OnDoubleClick
+// Left double-click switches to the next available audio device in the
+// switch list
+//
+// Parameters:
+//	inputTime	GetMessageTime() of the double-click
+//
+// Return values:
+//	none
+void TrayEventHandler::OnDoubleClick(LONG inputTime)
+{
+	LONGLONG switchStart = BackendTraceTimestamp();
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if (deviceList->SwitchCount())
+	{
+		// go to next available audio device index
+		int index = NextAvailableSwitchIndex(*deviceList, deviceList->switchListIndex);
+		RecordSwitchPhase(SWITCH_PHASE_ADVANCE, switchStart);
+
+		// set the playback device and change the icon if it worked
+		if (index >= 0)
+			SwitchToDevice(index, switchStart, inputTime);
+	}
+}
+
+// OnRightClick
+// Right-click makes the pop-up menu appear.  Only the first
+// MAX_MENU_DEVICE_ITEMS entries have command ids, so only they are listed.
+//
+// Parameters:
+//	none
+//
+// Return values:
+//	none
+void TrayEventHandler::OnRightClick()
+{
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	std::vector<TrayMenuItem> deviceItems;
+	for (int i = 0; (i < deviceList->SwitchCount()) && (i < MAX_MENU_DEVICE_ITEMS); i++)
+	{
+		TrayMenuItem item;
+		item.name = deviceList->SwitchName(i);
+		item.commandId = ID_ROOT_ITEM_0 + i;
+		item.available = IsSwitchIndexAvailable(*deviceList, i);
+		deviceItems.push_back(item);
+	}
+	m_view.ShowMenu(deviceItems);
+}
+
+// OnMenuCommand
+// Handles a command picked from the pop-up menu
+//
+// Parameters:
+//	commandId	The menu item's command id
+//	inputTime	GetMessageTime() of the command
+//
+// Return values:
+//	true	The command was handled
+//	false	Not a pop-up menu command
+bool TrayEventHandler::OnMenuCommand(int commandId, LONG inputTime)
+{
+	// handle the pop-up menu device selections
+	if ((commandId >= ID_ROOT_ITEM_0) && (commandId < ID_ROOT_ITEM_0 + MAX_MENU_DEVICE_ITEMS))
+	{
+		// set the audio source to the selected item
+		SwitchToDevice(commandId - ID_ROOT_ITEM_0, BackendTraceTimestamp(), inputTime);
+		return true;
+	}
+
+	switch (commandId)
+	{
+	// handle pop-up menu item 'quit'
+	case ID_ROOT_QUIT:
+		m_view.Quit();
+		return true;
+
+	// handle pop-up menu item 'reselect audio devices'
+	case ID_ROOT_RESELECT:
+		m_view.ShowDeviceSelection();
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,73 @@
+// ----------------------------------------------------------------------------
+// trayevents.h
+// Handlers for the tray icon's clicks and pop-up menu commands
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <string>
+#include <vector>
+
+// number of device entries the pop-up menu has command ids for
+#define MAX_MENU_DEVICE_ITEMS		20
+
+// TrayMenuItem
+// One device entry of the pop-up menu
+struct TrayMenuItem
+{
+	std::wstring name;		// the toggle list entry
+	int commandId;			// ID_ROOT_ITEM_0 + the entry's switch list index
+	bool available;			// false to show the entry greyed out
+};
+
+// ITrayDeviceBackend
+// The audio backend the tray handlers switch devices through
+class ITrayDeviceBackend
+{
+public:
+	virtual ~ITrayDeviceBackend() {}
+
+	// makes the toggle list entry the playback device - 0 on success, -1 if
+	// it could not be set.  recordTiming is true for switches the user asked for.
+	virtual int SetActiveDevice(int deviceSwitchListIndex, bool recordTiming) = 0;
+};
+
+// ITrayView
+// The tray icon and window the handlers show their results on
+class ITrayView
+{
+public:
+	virtual ~ITrayView() {}
+
+	// shows the current toggle list entry's icon
+	virtual void UpdateIcon() = 0;
+
+	// pops up the menu with the device entries followed by re-select and quit
+	virtual void ShowMenu(const std::vector<TrayMenuItem>& deviceItems) = 0;
+
+	// opens the device selection dialog
+	virtual void ShowDeviceSelection() = 0;
+
+	// closes the app
+	virtual void Quit() = 0;
+};
+
+// TrayEventHandler
+// What each tray event does, independent of the window and the audio backend
+// it runs against, so the same handlers can be driven without either.
+// inputTime is the GetMessageTime() of the message that caused the event.
+class TrayEventHandler
+{
+public:
+	TrayEventHandler(ITrayDeviceBackend& backend, ITrayView& view);
+
+	int SwitchToDevice(int index, LONGLONG switchStart, LONG inputTime);
+	void OnDoubleClick(LONG inputTime);
+	void OnRightClick();
+	bool OnMenuCommand(int commandId, LONG inputTime);
+
+private:
+	ITrayDeviceBackend& m_backend;
+	ITrayView& m_view;
+};
@@ -0,0 +1,131 @@
+// ----------------------------------------------------------------------------
+// traywindow.cpp
+// The tray handlers bound to the app's window and audio backend
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "resource.h"
+#include "main.h"
+#include "traywindow.h"
+#include "deviceselectdialog.h"
+#include "devicediscovery.h"
+
+// the one backend every window event switches through
+static AudioDeviceBackend g_AudioDeviceBackend;
+
+
+// SetActiveDevice
+// Sets the toggle list entry as the playback device.  See
+// SetActiveAudioOutputDevice.
+int AudioDeviceBackend::SetActiveDevice(int deviceSwitchListIndex, bool recordTiming)
+{
+	return SetActiveAudioOutputDevice(deviceSwitchListIndex, recordTiming);
+}
+
+// TrayWindowView
+//
+// Parameters:
+//	hWnd	Window handle of the tray icon, receives the menu's WM_COMMAND
+TrayWindowView::TrayWindowView(HWND hWnd) :
+	m_hWnd(hWnd)
+{
+}
+
+// UpdateIcon
+// Changes the tray icon to match the current device.  See ChangeIcon.
+void TrayWindowView::UpdateIcon()
+{
+	ChangeIcon(m_hWnd);
+}
+
+// ShowMenu
+// Pops up the tray menu at the cursor.  The pick comes back to the window as
+// a WM_COMMAND.
+//
+// Parameters:
+//	deviceItems		The device entries to list above re-select and quit
+//
+// Return values:
+//	none
+void TrayWindowView::ShowMenu(const std::vector<TrayMenuItem>& deviceItems)
+{
+	HMENU hMenu = LoadMenu(g_hInstance, MAKEINTRESOURCE(IDR_POPUP));
+	if (hMenu)
+	{
+		HMENU hSubMenu = GetSubMenu(hMenu, 0);
+		if (hSubMenu)
+		{
+			// clear any/all items in the list
+			int menuItemCount = GetMenuItemCount(hSubMenu);
+			for (int i = 0; i < menuItemCount; i++)
+			{
+				DeleteMenu(hSubMenu, 0, MF_BYPOSITION);
+			}
+
+			// add all the selected/loaded items to the menu
+			for (size_t i = 0; i < deviceItems.size(); i++)
+			{
+				AppendMenu(hSubMenu, MF_STRING | (deviceItems[i].available ? 0 : MF_GRAYED), deviceItems[i].commandId, deviceItems[i].name.c_str());
+			}
+
+			// add quit and re-select items to the list
+			AppendMenu(hSubMenu, MF_SEPARATOR, 0, L"");
+			AppendMenu(hSubMenu, MF_STRING, ID_ROOT_RESELECT, L"Re-select Devices");
+			AppendMenu(hSubMenu, MF_STRING, ID_ROOT_QUIT, L"Quit");
+
+			// track the popup menu
+			POINT stPoint;
+			GetCursorPos(&stPoint);
+			TrackPopupMenu(hSubMenu, TPM_LEFTALIGN | TPM_BOTTOMALIGN | TPM_RIGHTBUTTON, stPoint.x, stPoint.y, 0, m_hWnd, NULL);
+		}
+		DestroyMenu(hMenu);
+	}
+}
+
+// ShowDeviceSelection
+// Opens the device selection dialog
+void TrayWindowView::ShowDeviceSelection()
+{
+	SelectDevicesDialog();
+}
+
+// Quit
+// Closes the window, which exits the app
+void TrayWindowView::Quit()
+{
+	DestroyWindow(m_hWnd);
+}
+
+// SwitchToDevice
+// Sets the toggle list entry as the playback device and updates the window's
+// icon if it worked.  See TrayEventHandler::SwitchToDevice.
+int SwitchToDevice(HWND hWnd, int index, LONGLONG switchStart, LONG inputTime)
+{
+	TrayWindowView view(hWnd);
+	return TrayEventHandler(g_AudioDeviceBackend, view).SwitchToDevice(index, switchStart, inputTime);
+}
+
+// OnTrayDoubleClick
+// See TrayEventHandler::OnDoubleClick
+void OnTrayDoubleClick(HWND hWnd, LONG inputTime)
+{
+	TrayWindowView view(hWnd);
+	TrayEventHandler(g_AudioDeviceBackend, view).OnDoubleClick(inputTime);
+}
+
+// OnTrayRightClick
+// See TrayEventHandler::OnRightClick
+void OnTrayRightClick(HWND hWnd)
+{
+	TrayWindowView view(hWnd);
+	TrayEventHandler(g_AudioDeviceBackend, view).OnRightClick();
+}
+
+// OnTrayMenuCommand
+// See TrayEventHandler::OnMenuCommand
+bool OnTrayMenuCommand(HWND hWnd, int commandId, LONG inputTime)
+{
+	TrayWindowView view(hWnd);
+	return TrayEventHandler(g_AudioDeviceBackend, view).OnMenuCommand(commandId, inputTime);
+}
@@ -0,0 +1,40 @@
+// ----------------------------------------------------------------------------
+// traywindow.h
+// The tray handlers bound to the app's window and audio backend
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include "trayevents.h"
+
+// AudioDeviceBackend
+// Switches devices through the Windows audio backend (devicediscovery.cpp)
+class AudioDeviceBackend : public ITrayDeviceBackend
+{
+public:
+	int SetActiveDevice(int deviceSwitchListIndex, bool recordTiming);
+};
+
+// TrayWindowView
+// The tray icon, pop-up menu and dialogs of the app's window
+class TrayWindowView : public ITrayView
+{
+public:
+	TrayWindowView(HWND hWnd);
+
+	void UpdateIcon();
+	void ShowMenu(const std::vector<TrayMenuItem>& deviceItems);
+	void ShowDeviceSelection();
+	void Quit();
+
+private:
+	HWND m_hWnd;
+};
+
+// Routines called by WndProc for each tray event.  inputTime is the
+// GetMessageTime() of the message that caused it.
+int SwitchToDevice(HWND hWnd, int index, LONGLONG switchStart, LONG inputTime);
+void OnTrayDoubleClick(HWND hWnd, LONG inputTime);
+void OnTrayRightClick(HWND hWnd);
+bool OnTrayMenuCommand(HWND hWnd, int commandId, LONG inputTime);
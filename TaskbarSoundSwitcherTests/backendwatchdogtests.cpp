@@ -0,0 +1,224 @@
+// ----------------------------------------------------------------------------
+// backendwatchdogtests.cpp
+// Tests of the backend watchdog's deadline, switch budget and per-device
+// circuit breaker
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "backendwatchdog.h"
+
+#include <vector>
+
+// deadline the tests give calls that are meant to miss it
+#define WATCHDOG_TEST_DEADLINE_MS	50
+
+// how long a test waits for a call it expects to finish before calling it a
+// failure.  Nothing waits this long unless something is broken.
+#define WATCHDOG_TEST_TIMEOUT_MS	10000
+
+
+// RunBlockedCall
+// Runs a call on deviceId that doesn't return until hGate is set
+//
+// Parameters:
+//	deviceId	Encoded id of the device the call is made on
+//	hGate		Manual reset event that lets the call finish
+//
+// Return values:
+//	HRESULT		What the watchdog returned for the call
+static HRESULT RunBlockedCall(LPCWSTR deviceId, HANDLE hGate)
+{
+	return RunWithDeadline(L"Blocked", deviceId, [hGate]() -> HRESULT
+	{
+		WaitForSingleObject(hGate, INFINITE);
+		return S_OK;
+	});
+}
+
+// RunQuickCall
+// Runs a call on deviceId that returns hr right away
+static HRESULT RunQuickCall(LPCWSTR deviceId, HRESULT hr)
+{
+	return RunWithDeadline(L"Quick", deviceId, [hr]() -> HRESULT { return hr; });
+}
+
+// TestDeadline
+// A call that finishes in time returns its own result; one that doesn't is
+// abandoned at the deadline with E_BACKEND_TIMEOUT
+static void TestDeadline()
+{
+	CHECK(S_FALSE == RunQuickCall(L"Deadline", S_FALSE));
+	CHECK(E_FAIL == RunQuickCall(L"Deadline", E_FAIL));
+
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+	ULONGLONG startTick = GetTickCount64();
+	CHECK(E_BACKEND_TIMEOUT == RunBlockedCall(L"Deadline", hGate));
+	ULONGLONG elapsed = GetTickCount64() - startTick;
+	CHECK(elapsed + 16 >= WATCHDOG_TEST_DEADLINE_MS);
+	CHECK(elapsed < WATCHDOG_TEST_TIMEOUT_MS);
+
+	// one timeout doesn't trip the breaker, and a success clears it
+	CHECK(!IsCircuitOpen(L"Deadline"));
+	CHECK(S_OK == RunQuickCall(L"Deadline", S_OK));
+	SetEvent(hGate);
+	CloseHandle(hGate);
+}
+
+// TestCircuitBreakerTrips
+// CIRCUIT_BREAKER_TRIP_COUNT timeouts in a row open the device's breaker, so
+// its calls are skipped without running; other devices are left alone
+static void TestCircuitBreakerTrips()
+{
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+	for (int i = 0; i < CIRCUIT_BREAKER_TRIP_COUNT; i++)
+	{
+		CHECK(!IsCircuitOpen(L"Trip"));
+		CHECK(E_BACKEND_TIMEOUT == RunBlockedCall(L"Trip", hGate));
+	}
+	CHECK(IsCircuitOpen(L"Trip"));
+
+	CHECK(E_BACKEND_CIRCUIT_OPEN == RunQuickCall(L"Trip", S_OK));
+
+	// calls that aren't tied to a device never trip anything
+	CHECK(!IsCircuitOpen(L"Other"));
+	for (int i = 0; i < CIRCUIT_BREAKER_TRIP_COUNT; i++)
+	{
+		CHECK(E_BACKEND_TIMEOUT == RunBlockedCall(NULL, hGate));
+	}
+	CHECK(S_OK == RunQuickCall(NULL, S_OK));
+
+	SetEvent(hGate);
+	CloseHandle(hGate);
+}
+
+// TestCircuitBreakerHalfOpen
+// Once the cooldown passes a tripped device gets one retry: a timeout opens
+// the breaker again right away, a success closes it
+static void TestCircuitBreakerHalfOpen()
+{
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	// trip the breaker with a cooldown that has already passed
+	g_CircuitBreakerCooldownMs = 0;
+	for (int i = 0; i < CIRCUIT_BREAKER_TRIP_COUNT; i++)
+	{
+		RunBlockedCall(L"HalfOpen", hGate);
+	}
+	g_CircuitBreakerCooldownMs = CIRCUIT_BREAKER_COOLDOWN_MS;
+
+	// the retry times out - open again without another full count
+	CHECK(!IsCircuitOpen(L"HalfOpen"));
+	CHECK(E_BACKEND_TIMEOUT == RunBlockedCall(L"HalfOpen", hGate));
+	CHECK(IsCircuitOpen(L"HalfOpen"));
+
+	// trip it again, this time the retry succeeds and closes the breaker
+	g_CircuitBreakerCooldownMs = 0;
+	for (int i = 0; i < CIRCUIT_BREAKER_TRIP_COUNT; i++)
+	{
+		RunBlockedCall(L"Recovers", hGate);
+	}
+	g_CircuitBreakerCooldownMs = CIRCUIT_BREAKER_COOLDOWN_MS;
+	CHECK(S_OK == RunQuickCall(L"Recovers", S_OK));
+	CHECK(E_BACKEND_TIMEOUT == RunBlockedCall(L"Recovers", hGate));
+	CHECK(!IsCircuitOpen(L"Recovers"));
+
+	SetEvent(hGate);
+	CloseHandle(hGate);
+}
+
+// TestBudget
+// Calls made under a budget stop waiting when it runs out even if their own
+// deadline is far off, aren't started once it is spent, and aren't held
+// against the device
+static void TestBudget()
+{
+	DWORD savedDeadlineMs = g_BackendDeadlineMs;
+	g_BackendDeadlineMs = WATCHDOG_TEST_TIMEOUT_MS;
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	BeginBackendBudget(WATCHDOG_TEST_DEADLINE_MS);
+	ULONGLONG startTick = GetTickCount64();
+	for (int i = 0; i < CIRCUIT_BREAKER_TRIP_COUNT; i++)
+	{
+		CHECK(E_BACKEND_TIMEOUT == RunBlockedCall(L"Budget", hGate));
+	}
+	CHECK(GetTickCount64() - startTick < WATCHDOG_TEST_TIMEOUT_MS);
+
+	CHECK(E_BACKEND_TIMEOUT == RunQuickCall(L"Budget", S_OK));
+	EndBackendBudget();
+
+	CHECK(!IsCircuitOpen(L"Budget"));
+	CHECK(S_OK == RunQuickCall(L"Budget", S_OK));
+
+	SetEvent(hGate);
+	CloseHandle(hGate);
+	g_BackendDeadlineMs = savedDeadlineMs;
+}
+
+// TestPool
+// A pool keeps its slots busy: while the first call is stuck the others run
+// through the remaining slot and end before it does, and no more than
+// maxInFlight calls ever run at once
+static void TestPool()
+{
+	const int callCount = 6;
+	const int maxInFlight = 2;
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	int inFlight = 0;
+	int mostInFlight = 0;
+	std::vector<int> endOrder;
+	std::vector<HRESULT> results(callCount, E_FAIL);
+	RunDeadlineCallPool(callCount, maxInFlight, [&](int i) -> HDEADLINECALL
+	{
+		inFlight++;
+		if (inFlight > mostInFlight)
+			mostInFlight = inFlight;
+		if (0 == i)
+		{
+			return BeginDeadlineCall(L"Blocked", NULL, [hGate]() -> HRESULT
+			{
+				WaitForSingleObject(hGate, INFINITE);
+				return S_OK;
+			});
+		}
+		return BeginDeadlineCall(L"Quick", NULL, []() -> HRESULT { return S_FALSE; });
+	},
+	[&](int i, HRESULT hr)
+	{
+		inFlight--;
+		endOrder.push_back(i);
+		results[i] = hr;
+	});
+
+	CHECK(maxInFlight == mostInFlight);
+	CHECK(0 == inFlight);
+	CHECK(callCount == (int)endOrder.size());
+	if (callCount == (int)endOrder.size())
+		CHECK(0 == endOrder.back());
+	CHECK(E_BACKEND_TIMEOUT == results[0]);
+	for (int i = 1; i < callCount; i++)
+	{
+		CHECK(S_FALSE == results[i]);
+	}
+
+	SetEvent(hGate);
+	CloseHandle(hGate);
+}
+
+// RunBackendWatchdogTests
+void RunBackendWatchdogTests()
+{
+	DWORD savedDeadlineMs = g_BackendDeadlineMs;
+	g_BackendDeadlineMs = WATCHDOG_TEST_DEADLINE_MS;
+
+	TestDeadline();
+	TestCircuitBreakerTrips();
+	TestCircuitBreakerHalfOpen();
+	TestBudget();
+	TestPool();
+
+	g_BackendDeadlineMs = savedDeadlineMs;
+}
@@ -0,0 +1,249 @@
+// ----------------------------------------------------------------------------
+// backgroundtaskstests.cpp
+// Tests of the background task queue's key replacement, delays, priority
+// lanes and stop
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "backgroundtasks.h"
+
+#include <atomic>
+#include <memory>
+
+// how long a test waits for a task it expects to run before calling it a
+// failure.  Nothing waits this long unless something is broken, so the tests
+// don't depend on how fast the machine is.
+#define TASK_TEST_TIMEOUT_MS	10000
+
+
+// BlockLowLane
+// Occupies the one worker low priority tasks may use until hGate is set, so
+// the tests can arrange the queue before anything in it runs
+//
+// Parameters:
+//	hGate	Manual reset event that lets the blocking task finish
+//
+// Return values:
+//	none
+static void BlockLowLane(HANDLE hGate)
+{
+	HANDLE hStarted = CreateEvent(NULL, FALSE, FALSE, NULL);
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Blocker", 0, [hGate, hStarted]()
+	{
+		SetEvent(hStarted);
+		WaitForSingleObject(hGate, INFINITE);
+	});
+	CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hStarted, TASK_TEST_TIMEOUT_MS));
+	CloseHandle(hStarted);
+}
+
+// DrainLowLane
+// Queues a low priority marker and waits for it, so every low priority task
+// that was due before it has run
+static void DrainLowLane()
+{
+	HANDLE hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Marker", 0, [hDone]() { SetEvent(hDone); });
+	CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hDone, TASK_TEST_TIMEOUT_MS));
+	CloseHandle(hDone);
+}
+
+// TestKeyReplacement
+// A task queued under a key that is still queued replaces the older one
+static void TestKeyReplacement()
+{
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+	BlockLowLane(hGate);
+
+	std::shared_ptr<std::atomic<int>> ran = std::make_shared<std::atomic<int>>(0);
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Replace", 0, [ran]() { *ran += 1; });
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Replace", 0, [ran]() { *ran += 10; });
+	CHECK(1 == GetBackgroundQueueDepth());
+
+	SetEvent(hGate);
+	DrainLowLane();
+	CHECK(10 == *ran);
+	CHECK(0 == GetBackgroundQueueDepth());
+	CloseHandle(hGate);
+}
+
+// TestDelayRestarts
+// Replacing a task starts its delay over: a task that was already due is
+// held back again once it is replaced with a delay
+static void TestDelayRestarts()
+{
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+	BlockLowLane(hGate);
+
+	std::shared_ptr<std::atomic<int>> ran = std::make_shared<std::atomic<int>>(0);
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Delay", 0, [ran]() { *ran += 1; });
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Delay", 60000, [ran]() { *ran += 1; });
+
+	SetEvent(hGate);
+	DrainLowLane();
+	CHECK(0 == *ran);
+	CHECK(1 == GetBackgroundQueueDepth());
+	CHECK(CancelBackgroundTask(L"Delay"));
+	CloseHandle(hGate);
+}
+
+// TestCancel
+// A cancelled task never runs, and only a queued task can be cancelled
+static void TestCancel()
+{
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+	BlockLowLane(hGate);
+
+	std::shared_ptr<std::atomic<int>> ran = std::make_shared<std::atomic<int>>(0);
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Cancel", 0, [ran]() { *ran += 1; });
+	CHECK(CancelBackgroundTask(L"Cancel"));
+	CHECK(!CancelBackgroundTask(L"Cancel"));
+
+	SetEvent(hGate);
+	DrainLowLane();
+	CHECK(0 == *ran);
+	CloseHandle(hGate);
+}
+
+// TestRunningKeyWaits
+// A task queued while another with the same key is running waits for it
+// instead of overlapping it, even with a worker free
+static void TestRunningKeyWaits()
+{
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+	HANDLE hStarted = CreateEvent(NULL, FALSE, FALSE, NULL);
+	HANDLE hSecondDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	std::shared_ptr<std::atomic<int>> running = std::make_shared<std::atomic<int>>(0);
+	std::shared_ptr<std::atomic<int>> overlapped = std::make_shared<std::atomic<int>>(0);
+
+	QueueBackgroundTask(TASK_PRIORITY_HIGH, L"Same", 0, [hGate, hStarted, running]()
+	{
+		*running += 1;
+		SetEvent(hStarted);
+		WaitForSingleObject(hGate, INFINITE);
+		*running -= 1;
+	});
+	CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hStarted, TASK_TEST_TIMEOUT_MS));
+	QueueBackgroundTask(TASK_PRIORITY_HIGH, L"Same", 0, [hSecondDone, running, overlapped]()
+	{
+		*overlapped += *running;
+		SetEvent(hSecondDone);
+	});
+
+	// the other worker is free, yet the second task is still queued
+	HANDLE hMarker = CreateEvent(NULL, TRUE, FALSE, NULL);
+	QueueBackgroundTask(TASK_PRIORITY_HIGH, L"HighMarker", 0, [hMarker]() { SetEvent(hMarker); });
+	CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hMarker, TASK_TEST_TIMEOUT_MS));
+	CHECK(WAIT_TIMEOUT == WaitForSingleObject(hSecondDone, 0));
+	CHECK(1 == GetBackgroundQueueDepth());
+
+	SetEvent(hGate);
+	CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hSecondDone, TASK_TEST_TIMEOUT_MS));
+	CHECK(0 == *overlapped);
+
+	CloseHandle(hMarker);
+	CloseHandle(hSecondDone);
+	CloseHandle(hStarted);
+	CloseHandle(hGate);
+}
+
+// TestLowLaneCap
+// Low priority tasks never take the last worker: one that is due waits while
+// another low priority task runs, and high priority work goes past it
+static void TestLowLaneCap()
+{
+	HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+	BlockLowLane(hGate);
+
+	std::shared_ptr<std::atomic<int>> lowRan = std::make_shared<std::atomic<int>>(0);
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Capped", 0, [lowRan]() { *lowRan += 1; });
+
+	HANDLE hHighDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	QueueBackgroundTask(TASK_PRIORITY_HIGH, L"Switch", 0, [hHighDone]() { SetEvent(hHighDone); });
+	CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hHighDone, TASK_TEST_TIMEOUT_MS));
+	CHECK(0 == *lowRan);
+	CHECK(1 == GetBackgroundQueueDepth());
+
+	SetEvent(hGate);
+	DrainLowLane();
+	CHECK(1 == *lowRan);
+
+	CloseHandle(hHighDone);
+	CloseHandle(hGate);
+}
+
+// TestSwitchLatencyUnderLoad
+// A switch queued on the high priority lane behind a growing backlog of low
+// priority work starts before any of that backlog runs, so how long it waits
+// doesn't grow with the backlog
+static void TestSwitchLatencyUnderLoad()
+{
+	const int backlogs[] = { 0, 64, 1024 };
+	for (int b = 0; b < ARRAYSIZE(backlogs); b++)
+	{
+		HANDLE hGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+		BlockLowLane(hGate);
+
+		std::shared_ptr<std::atomic<int>> backlogRan = std::make_shared<std::atomic<int>>(0);
+		for (int i = 0; i < backlogs[b]; i++)
+		{
+			WCHAR key[32];
+			swprintf_s(key, L"Load%d", i);
+			QueueBackgroundTask(TASK_PRIORITY_LOW, key, 0, [backlogRan]() { *backlogRan += 1; });
+		}
+		CHECK(backlogs[b] == GetBackgroundQueueDepth());
+
+		// what the backlog had done by the time the switch started
+		HANDLE hSwitchDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+		std::shared_ptr<std::atomic<int>> ranBeforeSwitch = std::make_shared<std::atomic<int>>(-1);
+		QueueBackgroundTask(TASK_PRIORITY_HIGH, L"Switch", 0, [hSwitchDone, backlogRan, ranBeforeSwitch]()
+		{
+			*ranBeforeSwitch = (int)*backlogRan;
+			SetEvent(hSwitchDone);
+		});
+		CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hSwitchDone, TASK_TEST_TIMEOUT_MS));
+		CHECK(0 == *ranBeforeSwitch);
+
+		SetEvent(hGate);
+		DrainLowLane();
+		CHECK(backlogs[b] == *backlogRan);
+
+		CloseHandle(hSwitchDone);
+		CloseHandle(hGate);
+	}
+}
+
+// TestStopFlushesOnlyItsKey
+// Stopping runs the flush key's task without waiting out its delay and
+// cancels everything else still queued
+static void TestStopFlushesOnlyItsKey()
+{
+	std::shared_ptr<std::atomic<int>> flushed = std::make_shared<std::atomic<int>>(0);
+	std::shared_ptr<std::atomic<int>> dropped = std::make_shared<std::atomic<int>>(0);
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Flush", 60000, [flushed]() { *flushed += 1; });
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Prefetch", 60000, [dropped]() { *dropped += 1; });
+	QueueBackgroundTask(TASK_PRIORITY_HIGH, L"DeviceRebuild", 60000, [dropped]() { *dropped += 1; });
+
+	ULONGLONG stopTick = GetTickCount64();
+	StopBackgroundTasks(L"Flush");
+	CHECK(1 == *flushed);
+	CHECK(0 == *dropped);
+	CHECK(0 == GetBackgroundQueueDepth());
+	CHECK(GetTickCount64() - stopTick < 60000);
+}
+
+// RunBackgroundTaskTests
+void RunBackgroundTaskTests()
+{
+	CHECK(0 == StartBackgroundTasks());
+
+	TestKeyReplacement();
+	TestDelayRestarts();
+	TestCancel();
+	TestRunningKeyWaits();
+	TestLowLaneCap();
+	TestSwitchLatencyUnderLoad();
+	TestStopFlushesOnlyItsKey();
+}
@@ -0,0 +1,129 @@
+// ----------------------------------------------------------------------------
+// deploypolicytests.cpp
+// Tests of the device classifier and the deployment policy file parser
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "deploypolicy.h"
+
+#include "Mmdeviceapi.h"	// EndpointFormFactor
+#include <string>
+
+
+// WritePolicyFile
+// Writes a policy file with the given text to the temp folder
+//
+// Parameters:
+//	text			The file's contents
+//	policyFilename	Set to the file's full path
+//
+// Return values:
+//	true	The file was written
+static bool WritePolicyFile(const char* text, std::string& policyFilename)
+{
+	char tempPath[MAX_PATH];
+	DWORD length = GetTempPathA(MAX_PATH, tempPath);
+	if ((0 == length) || (length >= MAX_PATH))
+		return false;
+	policyFilename = std::string(tempPath) + "DeployPolicyTest.cfg";
+
+	FILE* fp = nullptr;
+	if ((0 != fopen_s(&fp, policyFilename.c_str(), "w")) || (NULL == fp))
+		return false;
+	fputs(text, fp);
+	fclose(fp);
+	return true;
+}
+
+// TestClassifyByFormFactor
+// The form factor decides headsets and displays whatever the name says
+static void TestClassifyByFormFactor()
+{
+	CHECK(DEVICE_CLASS_HEADSET == ClassifyAudioOutputDevice(L"Speakers (USB Audio)", Headphones));
+	CHECK(DEVICE_CLASS_HEADSET == ClassifyAudioOutputDevice(L"Realtek Output", Headset));
+	CHECK(DEVICE_CLASS_HEADSET == ClassifyAudioOutputDevice(L"Phone", Handset));
+	CHECK(DEVICE_CLASS_HDMI == ClassifyAudioOutputDevice(L"DELL U2415", DigitalAudioDisplayDevice));
+	CHECK(DEVICE_CLASS_SPEAKERS == ClassifyAudioOutputDevice(L"Speakers (Realtek High Definition Audio)", Speakers));
+	CHECK(DEVICE_CLASS_SPEAKERS == ClassifyAudioOutputDevice(L"Digital Output", SPDIF));
+}
+
+// TestClassifyByName
+// Without a telling form factor the name decides, and a software device is
+// virtual whatever form factor it claims
+static void TestClassifyByName()
+{
+	// virtual names win over every form factor
+	CHECK(DEVICE_CLASS_VIRTUAL == ClassifyAudioOutputDevice(L"CABLE Input (VB-Audio Virtual Cable)", Speakers));
+	CHECK(DEVICE_CLASS_VIRTUAL == ClassifyAudioOutputDevice(L"VoiceMeeter Input", Headphones));
+	CHECK(DEVICE_CLASS_VIRTUAL == ClassifyAudioOutputDevice(L"Remote Audio", UnknownFormFactor));
+	CHECK(DEVICE_CLASS_VIRTUAL == ClassifyAudioOutputDevice(L"Speakers (Steam Streaming Speakers)", DigitalAudioDisplayDevice));
+
+	// the form factor couldn't be read, or the driver says speakers
+	CHECK(DEVICE_CLASS_HDMI == ClassifyAudioOutputDevice(L"ASUS VE248 (NVIDIA High Definition Audio) HDMI", UnknownFormFactor));
+	CHECK(DEVICE_CLASS_HDMI == ClassifyAudioOutputDevice(L"DisplayPort Out", Speakers));
+	CHECK(DEVICE_CLASS_HDMI == ClassifyAudioOutputDevice(L"Intel(R) Display Audio", UnknownFormFactor));
+	CHECK(DEVICE_CLASS_HEADSET == ClassifyAudioOutputDevice(L"Headphones (Logitech G430)", UnknownFormFactor));
+	CHECK(DEVICE_CLASS_HEADSET == ClassifyAudioOutputDevice(L"Bluetooth HEADSET", Speakers));
+	CHECK(DEVICE_CLASS_SPEAKERS == ClassifyAudioOutputDevice(L"Line Out", UnknownFormFactor));
+	CHECK(DEVICE_CLASS_SPEAKERS == ClassifyAudioOutputDevice(L"", UnknownFormFactor));
+}
+
+// TestLoadPolicy
+// Classes come back in file order, matched without regard to case or the
+// blanks around them; comments, blank lines, unknown names and repeats are
+// skipped
+static void TestLoadPolicy()
+{
+	std::string policyFilename;
+	CHECK(WritePolicyFile(
+		"# office machines\n"
+		"\n"
+		"  Headset\t\r\n"
+		"speakers\n"
+		"subwoofer\n"
+		"HEADSET\n"
+		"   # virtual\n"
+		"hdmi", policyFilename));
+
+	std::vector<int> classOrder;
+	CHECK(0 == LoadDeployPolicy(policyFilename, classOrder));
+	CHECK(3 == classOrder.size());
+	if (3 == classOrder.size())
+	{
+		CHECK(DEVICE_CLASS_HEADSET == classOrder[0]);
+		CHECK(DEVICE_CLASS_SPEAKERS == classOrder[1]);
+		CHECK(DEVICE_CLASS_HDMI == classOrder[2]);
+	}
+
+	// a policy with no classes in it is still a policy
+	CHECK(WritePolicyFile("# nothing selected\n", policyFilename));
+	classOrder.push_back(DEVICE_CLASS_VIRTUAL);
+	CHECK(0 == LoadDeployPolicy(policyFilename, classOrder));
+	CHECK(classOrder.empty());
+
+	DeleteFileA(policyFilename.c_str());
+}
+
+// TestNoPolicy
+// A missing file means there is no policy
+static void TestNoPolicy()
+{
+	std::string policyFilename;
+	CHECK(WritePolicyFile("virtual\n", policyFilename));
+	DeleteFileA(policyFilename.c_str());
+
+	std::vector<int> classOrder(1, DEVICE_CLASS_VIRTUAL);
+	CHECK(-1 == LoadDeployPolicy(policyFilename, classOrder));
+	CHECK(classOrder.empty());
+}
+
+// RunDeployPolicyTests
+void RunDeployPolicyTests()
+{
+	TestClassifyByFormFactor();
+	TestClassifyByName();
+	TestLoadPolicy();
+	TestNoPolicy();
+}
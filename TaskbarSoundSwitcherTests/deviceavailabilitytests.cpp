@@ -0,0 +1,168 @@
+// ----------------------------------------------------------------------------
+// deviceavailabilitytests.cpp
+// Tests of the enumeration diff and the availability bitmap scans
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "deviceavailability.h"
+#include "statusblock.h"
+
+
+// MakeDeviceList
+// Builds a snapshot with count entries named "Device <n>" and the given
+// availability bitmap
+static DeviceListSnapshot MakeDeviceList(int count, ULONGLONG availableMask)
+{
+	DeviceListSnapshot deviceList;
+	for (int i = 0; i < count; i++)
+	{
+		WCHAR name[32];
+		swprintf_s(name, L"Device %d", i);
+		deviceList.switchTable.Append(name);
+	}
+	deviceList.availableMask = availableMask;
+	return deviceList;
+}
+
+// TestMaskEdges
+// The scans at both ends of the 64 bit bitmap and past it
+static void TestMaskEdges()
+{
+	// only the last tracked entry
+	DeviceListSnapshot lastOnly = MakeDeviceList(MAX_TRACKED_TOGGLE_DEVICES, 1ULL << 63);
+	CHECK(63 == NextAvailableSwitchIndex(lastOnly, 0));
+	CHECK(63 == NextAvailableSwitchIndex(lastOnly, 63));
+	CHECK(63 == PreviousAvailableSwitchIndex(lastOnly, 0));
+	CHECK(63 == BestAvailableSwitchIndex(lastOnly));
+	CHECK(IsSwitchIndexAvailable(lastOnly, 63));
+	CHECK(!IsSwitchIndexAvailable(lastOnly, 62));
+
+	// the first and last entries, each wrapping to the other
+	DeviceListSnapshot ends = MakeDeviceList(MAX_TRACKED_TOGGLE_DEVICES, (1ULL << 63) | 1ULL);
+	CHECK(63 == NextAvailableSwitchIndex(ends, 0));
+	CHECK(0 == NextAvailableSwitchIndex(ends, 63));
+	CHECK(0 == PreviousAvailableSwitchIndex(ends, 63));
+	CHECK(63 == PreviousAvailableSwitchIndex(ends, 0));
+	CHECK(0 == NextAvailableSwitchIndex(ends, -1));
+	CHECK(0 == BestAvailableSwitchIndex(ends));
+
+	// only the upper half of the bitmap
+	DeviceListSnapshot upper = MakeDeviceList(MAX_TRACKED_TOGGLE_DEVICES, 1ULL << 40);
+	CHECK(40 == NextAvailableSwitchIndex(upper, 3));
+	CHECK(40 == PreviousAvailableSwitchIndex(upper, 3));
+
+	// entries past the bitmap are never marked unavailable or scanned
+	DeviceListSnapshot untracked = MakeDeviceList(MAX_TRACKED_TOGGLE_DEVICES + 6, ~0ULL);
+	CHECK(IsSwitchIndexAvailable(untracked, MAX_TRACKED_TOGGLE_DEVICES + 1));
+	CHECK(!IsSwitchIndexAvailable(untracked, MAX_TRACKED_TOGGLE_DEVICES + 6));
+	CHECK(0 == NextAvailableSwitchIndex(untracked, 63));
+	CHECK(63 == PreviousAvailableSwitchIndex(untracked, MAX_TRACKED_TOGGLE_DEVICES + 1));
+
+	// bits past the end of a short list are ignored
+	DeviceListSnapshot shortList = MakeDeviceList(3, ~0ULL);
+	CHECK(0 == NextAvailableSwitchIndex(shortList, 2));
+	CHECK(2 == PreviousAvailableSwitchIndex(shortList, 0));
+	CHECK(!IsSwitchIndexAvailable(shortList, 3));
+	CHECK(!IsSwitchIndexAvailable(shortList, -1));
+
+	// nothing available
+	DeviceListSnapshot none = MakeDeviceList(MAX_TRACKED_TOGGLE_DEVICES, 0);
+	CHECK(-1 == NextAvailableSwitchIndex(none, 0));
+	CHECK(-1 == PreviousAvailableSwitchIndex(none, 0));
+	CHECK(-1 == BestAvailableSwitchIndex(none));
+}
+
+// TestMatchActiveDevices
+// The bitmap built from the last enumeration's device names
+static void TestMatchActiveDevices()
+{
+	DeviceListSnapshot deviceList;
+	deviceList.switchTable.Append(L"Speakers");
+	deviceList.switchTable.Append(L"Headphones");
+	deviceList.switchTable.Append(L"HDMI");
+	CompileToggleList(deviceList);
+
+	deviceList.activeTable.Append(L"Realtek Speakers", L"{a}");
+	deviceList.activeTable.Append(L"Dock HDMI Output", L"{c}");
+	CHECK(0x5ULL == MatchActiveDevices(deviceList));
+
+	deviceList.activeTable = DeviceTable();
+	CHECK(0 == MatchActiveDevices(deviceList));
+}
+
+// TestEnumerationTable
+// The last enumeration's rows keep their ids and names, and are found by id
+static void TestEnumerationTable()
+{
+	std::vector<std::wstring> ids, names;
+	ids.push_back(L"{a}");	names.push_back(L"Speakers");
+	ids.push_back(L"{b}");	names.push_back(L"Headphones");
+
+	DeviceTable devices;
+	devices.Append(L"Old Device", L"{z}");
+	devices.Assign(ids, names);
+	CHECK(2 == devices.Count());
+	CHECK(0 == wcscmp(L"{b}", devices.Id(1)));
+	CHECK(0 == wcscmp(L"Headphones", devices.Name(1)));
+	CHECK(DEVICE_ICON_HEADPHONES == devices.iconClasses[1]);
+	CHECK(1 == devices.FindId(L"{b}"));
+	CHECK(-1 == devices.FindId(L"{z}"));
+	CHECK(-1 == devices.FindId(L"{"));
+
+	// toggle list entries have empty ids
+	devices.Append(L"HDMI");
+	CHECK(0 == wcscmp(L"", devices.Id(2)));
+	CHECK(0 == wcscmp(L"HDMI", devices.Name(2)));
+}
+
+// TestDiff
+// Adds, removes and renames, keyed by id regardless of enumeration order
+static void TestDiff()
+{
+	std::vector<std::wstring> oldIds, oldNames, newIds, newNames;
+	oldIds.push_back(L"{a}");	oldNames.push_back(L"Speakers");
+	oldIds.push_back(L"{b}");	oldNames.push_back(L"Headphones");
+	oldIds.push_back(L"{c}");	oldNames.push_back(L"HDMI");
+	DeviceTable oldDevices;
+	oldDevices.Assign(oldIds, oldNames);
+
+	DeviceListDiff diff;
+	DiffAudioOutputDevices(oldDevices, oldIds, oldNames, diff);
+	CHECK(diff.Empty());
+
+	// same devices in another order
+	newIds.push_back(L"{c}");	newNames.push_back(L"HDMI");
+	newIds.push_back(L"{a}");	newNames.push_back(L"Speakers");
+	newIds.push_back(L"{b}");	newNames.push_back(L"Headphones");
+	DiffAudioOutputDevices(oldDevices, newIds, newNames, diff);
+	CHECK(diff.Empty());
+
+	// {a} unplugged, {c} renamed, {d} plugged in
+	newIds.clear();
+	newNames.clear();
+	newIds.push_back(L"{b}");	newNames.push_back(L"Headphones");
+	newIds.push_back(L"{c}");	newNames.push_back(L"Dock HDMI");
+	newIds.push_back(L"{d}");	newNames.push_back(L"USB Headset");
+	DiffAudioOutputDevices(oldDevices, newIds, newNames, diff);
+	CHECK(!diff.Empty());
+	CHECK((1 == diff.addedIds.size()) && (L"{d}" == diff.addedIds[0]));
+	CHECK((1 == diff.addedNames.size()) && (L"USB Headset" == diff.addedNames[0]));
+	CHECK((1 == diff.removedIds.size()) && (L"{a}" == diff.removedIds[0]));
+	CHECK((1 == diff.renamedIds.size()) && (L"{c}" == diff.renamedIds[0]));
+
+	// everything unplugged
+	DiffAudioOutputDevices(oldDevices, std::vector<std::wstring>(), std::vector<std::wstring>(), diff);
+	CHECK(3 == diff.removedIds.size());
+	CHECK(diff.addedIds.empty() && diff.renamedIds.empty());
+}
+
+// RunDeviceAvailabilityTests
+void RunDeviceAvailabilityTests()
+{
+	TestMaskEdges();
+	TestMatchActiveDevices();
+	TestEnumerationTable();
+	TestDiff();
+}
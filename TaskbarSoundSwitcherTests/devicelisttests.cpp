@@ -0,0 +1,185 @@
+// ----------------------------------------------------------------------------
+// devicelisttests.cpp
+// Stress test of the device list snapshots: readers on several threads
+// acquire snapshots while writers publish and update them
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "devicelist.h"
+
+#include <atomic>
+
+// snapshots the publishing writer replaces the list with
+#define STRESS_PUBLISHES		20000
+
+// threads reading the list while it is replaced
+#define STRESS_READERS			4
+
+// how long the test waits for a reader to finish before calling it hung
+#define STRESS_TIMEOUT_MS		30000
+
+
+// StressState
+// What the readers and writers share
+struct StressState
+{
+	std::atomic<bool> publishing;		// false once the publishing writer is done
+	std::atomic<long> reads;			// snapshots checked by all readers
+	std::atomic<long> torn;				// snapshots that weren't consistent
+	std::atomic<long> backwards;		// snapshots older than one already seen
+};
+
+// EntryName
+// Name of entry i of the snapshot of the given generation
+static std::wstring EntryName(unsigned int generation, int i)
+{
+	WCHAR name[64];
+	swprintf_s(name, L"Gen %u Entry %d", generation, i);
+	return name;
+}
+
+// PublishStressSnapshot
+// Publishes a snapshot whose every field is worked out from its generation,
+// so a reader can tell from any one field what all the others must be
+//
+// Parameters:
+//	generation	Number of the snapshot
+//
+// Return values:
+//	none
+static void PublishStressSnapshot(unsigned int generation)
+{
+	int count = (int)(generation % 8) + 1;
+	std::shared_ptr<DeviceListSnapshot> deviceList = std::make_shared<DeviceListSnapshot>();
+	for (int i = 0; i < count; i++)
+	{
+		deviceList->switchTable.Append(EntryName(generation, i));
+		deviceList->activeTable.Append(EntryName(generation, i), EntryName(generation, i));
+	}
+	deviceList->availableMask = (1ULL << count) - 1;
+	deviceList->activeDevicesEnumerated = true;
+	deviceList->switchListIndex = (int)(generation % count);
+	PublishDeviceList(deviceList);
+}
+
+// IsConsistent
+// Checks every field of a snapshot agrees with the generation named in its
+// first entry
+//
+// Parameters:
+//	deviceList	The snapshot
+//	generation	Set to the snapshot's generation
+//
+// Return values:
+//	true	The snapshot is one a writer published (or updated) whole
+static bool IsConsistent(const DeviceListSnapshot& deviceList, unsigned int& generation)
+{
+	int count = deviceList.SwitchCount();
+	if ((count < 1) || (0 != wcsncmp(deviceList.SwitchName(0), L"Gen ", 4)))
+		return false;
+	generation = wcstoul(deviceList.SwitchName(0) + 4, NULL, 10);
+	if ((count != (int)(generation % 8) + 1) ||
+		(count != (int)deviceList.switchTable.iconClasses.size()) ||
+		(count != deviceList.activeTable.Count()) ||
+		(deviceList.availableMask != (1ULL << count) - 1) ||
+		(deviceList.switchListIndex < 0) || (deviceList.switchListIndex >= count) ||
+		!deviceList.matcher || (count != deviceList.matcher->EntryCount()))
+		return false;
+
+	for (int i = 0; i < count; i++)
+	{
+		std::wstring name = EntryName(generation, i);
+		if ((name != deviceList.SwitchName(i)) || (name != deviceList.activeTable.Name(i)) ||
+			(name != deviceList.activeTable.Id(i)) || !deviceList.matcher->Matches(name, i))
+			return false;
+	}
+	return true;
+}
+
+// StressReaderThreadProc
+// Acquires and checks snapshots until the publishing writer is done.  A
+// reader never sees an older generation than one it has already seen.
+static DWORD WINAPI StressReaderThreadProc(LPVOID lpParam)
+{
+	StressState* state = (StressState*)lpParam;
+	unsigned int lastGeneration = 0;
+	bool done = false;
+	while (!done)
+	{
+		// one more pass after the writer stops, so the last snapshot is read
+		done = !state->publishing;
+
+		DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+		unsigned int generation;
+		if (!IsConsistent(*deviceList, generation))
+			state->torn++;
+		else if (generation < lastGeneration)
+			state->backwards++;
+		else
+			lastGeneration = generation;
+		state->reads++;
+	}
+	return 0;
+}
+
+// StressUpdaterThreadProc
+// A second writer that moves the current entry along through UpdateDeviceList,
+// as switching does, while the first replaces the whole list
+static DWORD WINAPI StressUpdaterThreadProc(LPVOID lpParam)
+{
+	StressState* state = (StressState*)lpParam;
+	while (state->publishing)
+	{
+		UpdateDeviceList([](DeviceListSnapshot& deviceList) -> bool
+		{
+			deviceList.switchListIndex = (deviceList.switchListIndex + 1) % deviceList.SwitchCount();
+			return true;
+		});
+	}
+	return 0;
+}
+
+// TestConcurrentReaders
+// Readers running flat out while the list is replaced and updated only ever
+// see whole snapshots, each at least as new as the last one they saw
+static void TestConcurrentReaders()
+{
+	StressState state;
+	state.publishing = true;
+	state.reads = 0;
+	state.torn = 0;
+	state.backwards = 0;
+	PublishStressSnapshot(1);
+
+	HANDLE hThreads[STRESS_READERS + 1];
+	for (int i = 0; i < STRESS_READERS; i++)
+		hThreads[i] = CreateThread(NULL, 0, StressReaderThreadProc, &state, 0, NULL);
+	hThreads[STRESS_READERS] = CreateThread(NULL, 0, StressUpdaterThreadProc, &state, 0, NULL);
+
+	for (unsigned int generation = 2; generation < STRESS_PUBLISHES + 2; generation++)
+		PublishStressSnapshot(generation);
+	state.publishing = false;
+
+	for (int i = 0; i < STRESS_READERS + 1; i++)
+	{
+		CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hThreads[i], STRESS_TIMEOUT_MS));
+		CloseHandle(hThreads[i]);
+	}
+
+	CHECK(state.reads >= STRESS_READERS);
+	CHECK(0 == state.torn);
+	CHECK(0 == state.backwards);
+	unsigned int generation;
+	CHECK(IsConsistent(*AcquireDeviceList(), generation));
+	CHECK(STRESS_PUBLISHES + 1 == generation);
+	printf("Device list stress: %d publishes, %ld snapshots read by %d readers\n",
+		STRESS_PUBLISHES, (long)state.reads, STRESS_READERS);
+}
+
+// RunDeviceListTests
+void RunDeviceListTests()
+{
+	TestConcurrentReaders();
+}
@@ -0,0 +1,266 @@
+// ----------------------------------------------------------------------------
+// headlesstray.cpp
+// Drives the tray handlers without a window or audio devices and times each
+// stage from the synthetic input to the feedback the user would see
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "headlesstray.h"
+#include "devicelist.h"
+#include "deviceavailability.h"
+#include "backendwatchdog.h"
+
+#include <algorithm>
+#include <math.h>
+
+
+// HeadlessClock
+// Starts the clock at zero
+HeadlessClock::HeadlessClock() :
+	m_simulatedUs(0)
+{
+	LARGE_INTEGER value;
+	QueryPerformanceFrequency(&value);
+	m_ticksPerUs = (double)value.QuadPart / 1000000.0;
+	QueryPerformanceCounter(&value);
+	m_start = value.QuadPart;
+}
+
+// Now
+// Returns the real time since the clock was made plus the simulated time
+double HeadlessClock::Now() const
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (double)(now.QuadPart - m_start) / m_ticksPerUs + m_simulatedUs;
+}
+
+// Advance
+// Moves the clock forward as if elapsedUs had passed
+void HeadlessClock::Advance(double elapsedUs)
+{
+	m_simulatedUs += elapsedUs;
+}
+
+// SimulatedDeviceBackend
+//
+// Parameters:
+//	clock	Clock the calls are timed with
+SimulatedDeviceBackend::SimulatedDeviceBackend(HeadlessClock& clock) :
+	defaultIndex(-1),
+	setCount(0),
+	callStart(0),
+	callEnd(0),
+	resolveUs(0),
+	setUs(0),
+	m_clock(clock)
+{
+}
+
+// SetLatencyModels
+// Makes the entries answer like the given kinds of device
+//
+// Parameters:
+//	models	Model of each entry, by index and wrapping around.  Empty to
+//			answer at once.
+//	seed	Seed of the draws, so a run can be repeated exactly
+//
+// Return values:
+//	none
+void SimulatedDeviceBackend::SetLatencyModels(const std::vector<DeviceLatencyModel>& models, unsigned int seed)
+{
+	m_models = models;
+	m_random.seed(seed);
+}
+
+// Sample
+// Draws one call time from a log-normal distribution around medianUs
+double SimulatedDeviceBackend::Sample(double medianUs, double spread)
+{
+	if (spread <= 0)
+		return medianUs;
+	std::lognormal_distribution<double> distribution(log(medianUs), spread);
+	return distribution(m_random);
+}
+
+// SetActiveDevice
+// Makes the entry the default if it is in the current device list and
+// available, taking as long as the entry's latency model says
+int SimulatedDeviceBackend::SetActiveDevice(int deviceSwitchListIndex, bool recordTiming)
+{
+	callStart = m_clock.Now();
+	setCount++;
+	resolveUs = 0;
+	setUs = 0;
+
+	int result = -1;
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if ((deviceSwitchListIndex >= 0) && (deviceSwitchListIndex < deviceList->SwitchCount()) &&
+		IsSwitchIndexAvailable(*deviceList, deviceSwitchListIndex))
+	{
+		result = 0;
+		if (!m_models.empty())
+		{
+			const DeviceLatencyModel& model = m_models[deviceSwitchListIndex % m_models.size()];
+			resolveUs = Sample(model.resolveMedianUs, model.spread);
+			if (std::uniform_real_distribution<double>(0, 1)(m_random) < model.stallRate)
+			{
+				setUs = DEFAULT_BACKEND_DEADLINE_MS * 1000.0;
+				result = -1;
+			}
+			else
+			{
+				setUs = Sample(model.setMedianUs, model.spread);
+			}
+			m_clock.Advance(resolveUs + setUs);
+		}
+		if (0 == result)
+			defaultIndex = deviceSwitchListIndex;
+	}
+
+	callEnd = m_clock.Now();
+	return result;
+}
+
+// HeadlessTrayView
+//
+// Parameters:
+//	clock	Clock the feedback is timed with
+HeadlessTrayView::HeadlessTrayView(HeadlessClock& clock) :
+	iconUpdates(0),
+	iconClass(-1),
+	menusShown(0),
+	selectionsShown(0),
+	quit(false),
+	feedbackTime(0),
+	m_clock(clock)
+{
+}
+
+// UpdateIcon
+// Records the icon class of the current entry, as ChangeIcon would pick it
+void HeadlessTrayView::UpdateIcon()
+{
+	DeviceListSnapshotPtr deviceList = AcquireDeviceList();
+	if ((deviceList->switchListIndex >= 0) && (deviceList->switchListIndex < deviceList->SwitchCount()))
+		iconClass = deviceList->SwitchIconClass(deviceList->switchListIndex);
+	iconUpdates++;
+	feedbackTime = m_clock.Now();
+}
+
+// ShowMenu
+// Records the menu's device entries
+void HeadlessTrayView::ShowMenu(const std::vector<TrayMenuItem>& deviceItems)
+{
+	menu = deviceItems;
+	menusShown++;
+	feedbackTime = m_clock.Now();
+}
+
+// ShowDeviceSelection
+// Records that the dialog would have opened
+void HeadlessTrayView::ShowDeviceSelection()
+{
+	selectionsShown++;
+	feedbackTime = m_clock.Now();
+}
+
+// Quit
+// Records that the app would have closed
+void HeadlessTrayView::Quit()
+{
+	quit = true;
+	feedbackTime = m_clock.Now();
+}
+
+// HeadlessTrayDriver
+//
+// Parameters:
+//	backend		Backend the handlers switch through
+//	view		View the handlers show their results on
+//	clock		Clock the backend and view are timed with
+HeadlessTrayDriver::HeadlessTrayDriver(SimulatedDeviceBackend& backend, HeadlessTrayView& view, HeadlessClock& clock) :
+	m_backend(backend),
+	m_view(view),
+	m_clock(clock),
+	m_handler(backend, view)
+{
+}
+
+// DoubleClick
+// Feeds a WM_LBUTTONDBLCLK on the tray icon to the handlers
+TrayEventTiming HeadlessTrayDriver::DoubleClick()
+{
+	int setCountBefore = m_backend.setCount;
+	double feedbackBefore = m_view.feedbackTime;
+	double inputTime = m_clock.Now();
+	m_handler.OnDoubleClick((LONG)GetTickCount());
+	return Finish(inputTime, setCountBefore, feedbackBefore);
+}
+
+// RightClick
+// Feeds a WM_RBUTTONDOWN on the tray icon to the handlers
+TrayEventTiming HeadlessTrayDriver::RightClick()
+{
+	int setCountBefore = m_backend.setCount;
+	double feedbackBefore = m_view.feedbackTime;
+	double inputTime = m_clock.Now();
+	m_handler.OnRightClick();
+	return Finish(inputTime, setCountBefore, feedbackBefore);
+}
+
+// MenuCommand
+// Feeds the WM_COMMAND of a pop-up menu pick to the handlers
+//
+// Parameters:
+//	commandId	The menu item's command id
+TrayEventTiming HeadlessTrayDriver::MenuCommand(int commandId)
+{
+	int setCountBefore = m_backend.setCount;
+	double feedbackBefore = m_view.feedbackTime;
+	double inputTime = m_clock.Now();
+	m_handler.OnMenuCommand(commandId, (LONG)GetTickCount());
+	return Finish(inputTime, setCountBefore, feedbackBefore);
+}
+
+// Finish
+// Works out the stage timings of the event that started at inputTime from
+// what the backend and view recorded while it ran
+TrayEventTiming HeadlessTrayDriver::Finish(double inputTime, int setCountBefore, double feedbackBefore)
+{
+	TrayEventTiming timing = {};
+	timing.feedback = (m_view.feedbackTime != feedbackBefore);
+	double endTime = timing.feedback ? m_view.feedbackTime : m_clock.Now();
+	timing.totalUs = endTime - inputTime;
+	if (m_backend.setCount != setCountBefore)
+	{
+		timing.dispatchUs = m_backend.callStart - inputTime;
+		timing.backendUs = m_backend.callEnd - m_backend.callStart;
+		timing.iconUs = endTime - m_backend.callEnd;
+	}
+	return timing;
+}
+
+// SummarizeLatency
+// Works out the percentiles of a set of timings
+//
+// Parameters:
+//	samples		The timings, in any order
+//
+// Return values:
+//	The summary, all zero if there are no samples
+LatencySummary SummarizeLatency(std::vector<double> samples)
+{
+	LatencySummary summary = {};
+	summary.count = samples.size();
+	if (samples.empty())
+		return summary;
+
+	std::sort(samples.begin(), samples.end());
+	summary.median = samples[(samples.size() - 1) / 2];
+	summary.p95 = samples[(size_t)((samples.size() - 1) * 0.95)];
+	summary.p99 = samples[(size_t)((samples.size() - 1) * 0.99)];
+	summary.max = samples.back();
+	return summary;
+}
@@ -0,0 +1,143 @@
+// ----------------------------------------------------------------------------
+// headlesstray.h
+// Drives the tray handlers without a window or audio devices and times each
+// stage from the synthetic input to the feedback the user would see
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include "trayevents.h"
+
+#include <random>
+#include <vector>
+
+// HeadlessClock
+// Microseconds since the clock was made.  Time the simulated backend spends
+// "in the driver" is added with Advance instead of being slept, so runs with
+// slow devices take no longer than runs with fast ones.
+class HeadlessClock
+{
+public:
+	HeadlessClock();
+
+	double Now() const;
+	void Advance(double elapsedUs);
+
+private:
+	LONGLONG m_start;			// QueryPerformanceCounter() when made
+	double m_ticksPerUs;
+	double m_simulatedUs;		// total Advance()d so far
+};
+
+// DeviceLatencyModel
+// How long a kind of audio device takes to answer.  Each call's time is drawn
+// from a log-normal distribution around its median, in microseconds.  A
+// stallRate share of set-default calls hang until the watchdog abandons them
+// and fail.
+struct DeviceLatencyModel
+{
+	const char* name;
+	double resolveMedianUs;		// finding the endpoint id
+	double setMedianUs;			// making it the default device
+	double spread;				// sigma of the log-normal - 0 for a fixed time
+	double stallRate;			// 0 to 1
+};
+
+// SimulatedDeviceBackend
+// A stand-in for the Windows audio backend that keeps the default device in
+// memory.  Entries that are out of range or not available can't be set.
+// Without latency models it answers at once; with them each entry answers
+// like the model at its index (wrapping around), on the clock.
+class SimulatedDeviceBackend : public ITrayDeviceBackend
+{
+public:
+	SimulatedDeviceBackend(HeadlessClock& clock);
+
+	void SetLatencyModels(const std::vector<DeviceLatencyModel>& models, unsigned int seed);
+	int SetActiveDevice(int deviceSwitchListIndex, bool recordTiming);
+
+	int defaultIndex;			// entry last made the default, -1 before the first switch
+	int setCount;				// SetActiveDevice calls so far
+	double callStart;			// clock time the last SetActiveDevice started
+	double callEnd;				// clock time it returned
+	double resolveUs;			// simulated resolve time of the last call
+	double setUs;				// simulated set-default time of the last call
+
+private:
+	double Sample(double medianUs, double spread);
+
+	HeadlessClock& m_clock;
+	std::vector<DeviceLatencyModel> m_models;
+	std::mt19937 m_random;
+};
+
+// HeadlessTrayView
+// Records what the handlers would have shown instead of showing it
+class HeadlessTrayView : public ITrayView
+{
+public:
+	HeadlessTrayView(HeadlessClock& clock);
+
+	void UpdateIcon();
+	void ShowMenu(const std::vector<TrayMenuItem>& deviceItems);
+	void ShowDeviceSelection();
+	void Quit();
+
+	int iconUpdates;					// UpdateIcon calls so far
+	int iconClass;						// DEVICE_ICON_xxx shown by the last UpdateIcon
+	std::vector<TrayMenuItem> menu;		// device entries of the last menu shown
+	int menusShown;
+	int selectionsShown;
+	bool quit;
+	double feedbackTime;				// clock time of the last thing shown
+
+private:
+	HeadlessClock& m_clock;
+};
+
+// TrayEventTiming
+// How long each stage of one synthetic tray event took, in microseconds.
+// Events that never reach the backend (menus, dialogs) only have a total.
+struct TrayEventTiming
+{
+	bool feedback;			// false if the event showed nothing (ie: the switch failed)
+	double dispatchUs;		// input to the backend call starting - picking the entry
+	double backendUs;		// the backend call
+	double iconUs;			// the backend call returning to the new icon
+	double totalUs;			// input to whatever the event showed
+};
+
+// HeadlessTrayDriver
+// Feeds synthetic tray events to a TrayEventHandler bound to a simulated
+// backend and headless view
+class HeadlessTrayDriver
+{
+public:
+	HeadlessTrayDriver(SimulatedDeviceBackend& backend, HeadlessTrayView& view, HeadlessClock& clock);
+
+	TrayEventTiming DoubleClick();
+	TrayEventTiming RightClick();
+	TrayEventTiming MenuCommand(int commandId);
+
+private:
+	TrayEventTiming Finish(double inputTime, int setCountBefore, double feedbackBefore);
+
+	SimulatedDeviceBackend& m_backend;
+	HeadlessTrayView& m_view;
+	HeadlessClock& m_clock;
+	TrayEventHandler m_handler;
+};
+
+// LatencySummary
+// Percentiles of a set of timings, in microseconds
+struct LatencySummary
+{
+	size_t count;
+	double median;
+	double p95;
+	double p99;
+	double max;
+};
+
+LatencySummary SummarizeLatency(std::vector<double> samples);
@@ -0,0 +1,233 @@
+// ----------------------------------------------------------------------------
+// soaktests.cpp
+// Runs thousands of switches, enumerations and toggle list reloads back to
+// back and checks the process's handles and private bytes stop growing
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "headlesstray.h"
+#include "devicelist.h"
+#include "deviceavailability.h"
+#include "backendwatchdog.h"
+#include "backgroundtasks.h"
+
+#include <Psapi.h>			// GetProcessMemoryInfo()
+#pragma comment(lib, "Psapi.lib")
+
+// cycles run before the baseline is taken, so one-off allocations (the
+// circuit breaker's device entry, the queue's workers, the heap's own
+// bookkeeping) aren't counted as growth
+#define SOAK_WARMUP_CYCLES		1000
+
+// cycles measured against the baseline, and how often usage is sampled
+#define SOAK_CYCLES				20000
+#define SOAK_SAMPLE_CYCLES		5000
+
+// growth allowed over the whole run.  A leak of one handle or one device
+// list per cycle is well past both.
+#define SOAK_HANDLE_SLACK		16
+#define SOAK_PRIVATE_BYTES_SLACK	(1024 * 1024)
+
+// how long the soak waits for abandoned or finishing work to let go of its
+// handles before calling it a leak
+#define SOAK_SETTLE_TIMEOUT_MS	10000
+
+
+// SoakUsage
+// The process's resource usage at one point of the run
+struct SoakUsage
+{
+	DWORD handles;
+	SIZE_T privateBytes;
+	LONG deadlineCalls;		// deadline calls whose worker hasn't let go yet
+};
+
+// SampleUsage
+// Reads the process's current resource usage, the same counters the trace
+// log's resource lines come from
+static SoakUsage SampleUsage()
+{
+	SoakUsage usage = {};
+	PROCESS_MEMORY_COUNTERS_EX memoryCounters = {};
+	memoryCounters.cb = sizeof(memoryCounters);
+	GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&memoryCounters, sizeof(memoryCounters));
+	usage.privateBytes = memoryCounters.PrivateUsage;
+	GetProcessHandleCount(GetCurrentProcess(), &usage.handles);
+	usage.deadlineCalls = GetLiveDeadlineCallCount();
+	return usage;
+}
+
+// SettleDeadlineCalls
+// Waits for the workers of finished deadline calls to let go of them.  A
+// worker releases its call just after signalling it, so the count can lag the
+// last call by one for a moment.
+//
+// Parameters:
+//	target	Count to wait for
+//
+// Return values:
+//	true	The count came back down to target
+//	false	It was still above target after SOAK_SETTLE_TIMEOUT_MS
+static bool SettleDeadlineCalls(LONG target)
+{
+	ULONGLONG start = GetTickCount64();
+	while (GetLiveDeadlineCallCount() > target)
+	{
+		if (GetTickCount64() - start > SOAK_SETTLE_TIMEOUT_MS)
+			return false;
+		Sleep(1);
+	}
+	return true;
+}
+
+// PublishSoakToggleList
+// Publishes a fresh toggle list, as saving the device selection dialog does,
+// keeping the devices the last enumeration found
+//
+// Parameters:
+//	cycle	Cycle number - every other reload drops the last entry
+//
+// Return values:
+//	none
+static void PublishSoakToggleList(int cycle)
+{
+	static LPCWSTR const entries[] = { L"Speakers", L"Headphones", L"USB Headset", L"Bluetooth Headset" };
+	DeviceListSnapshotPtr current = AcquireDeviceList();
+
+	std::shared_ptr<DeviceListSnapshot> deviceList = std::make_shared<DeviceListSnapshot>();
+	int count = (cycle % 2) ? _countof(entries) - 1 : _countof(entries);
+	for (int i = 0; i < count; i++)
+		deviceList->switchTable.Append(entries[i]);
+	deviceList->activeTable = current->activeTable;
+	deviceList->switchListIndex = 0;
+	CompileToggleList(*deviceList);
+	deviceList->availableMask = MatchActiveDevices(*deviceList);
+	deviceList->activeDevicesEnumerated = true;
+	PublishDeviceList(deviceList);
+}
+
+// EnumerateSoakDevices
+// Stands in for a device change notification's re-enumeration: the USB and
+// Bluetooth headsets come and go on alternate cycles, and the result is
+// diffed against the last enumeration and matched against the toggle list
+//
+// Parameters:
+//	cycle	Cycle number
+//
+// Return values:
+//	none
+static void EnumerateSoakDevices(int cycle)
+{
+	std::vector<std::wstring> ids, names;
+	ids.push_back(L"{0.0.0.00000000}.{speakers}");
+	names.push_back(L"Speakers (Realtek High Definition Audio)");
+	ids.push_back(L"{0.0.0.00000000}.{headphones}");
+	names.push_back(L"Headphones (Realtek High Definition Audio)");
+	if (cycle % 2)
+	{
+		ids.push_back(L"{0.0.0.00000000}.{usb}");
+		names.push_back(L"USB Headset (USB Audio Device)");
+	}
+	if (cycle % 3)
+	{
+		ids.push_back(L"{0.0.0.00000000}.{bluetooth}");
+		names.push_back(L"Bluetooth Headset (Stereo)");
+	}
+
+	UpdateDeviceList([&ids, &names](DeviceListSnapshot& deviceList) -> bool
+	{
+		DeviceListDiff diff;
+		DiffAudioOutputDevices(deviceList.activeTable, ids, names, diff);
+		if (diff.Empty() && deviceList.activeDevicesEnumerated)
+			return false;
+		deviceList.activeTable.Assign(ids, names);
+		deviceList.availableMask = MatchActiveDevices(deviceList);
+		deviceList.activeDevicesEnumerated = true;
+		return true;
+	});
+}
+
+// RunSoakCycle
+// One cycle of everything the tray does over and over while it runs: a
+// re-enumeration, a double-click switch, a backend call under the watchdog,
+// a deferred background task and, now and then, a toggle list reload
+//
+// Parameters:
+//	driver	Driver bound to the simulated backend
+//	cycle	Cycle number
+//
+// Return values:
+//	none
+static void RunSoakCycle(HeadlessTrayDriver& driver, int cycle)
+{
+	EnumerateSoakDevices(cycle);
+	driver.DoubleClick();
+
+	HRESULT hr = RunWithDeadline(L"Soak", L"{0.0.0.00000000}.{speakers}", []() -> HRESULT { return S_OK; });
+	CHECK(S_OK == hr);
+
+	HANDLE hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	QueueBackgroundTask(TASK_PRIORITY_LOW, L"Soak", 0, [hDone]() { SetEvent(hDone); });
+	CHECK(WAIT_OBJECT_0 == WaitForSingleObject(hDone, SOAK_SETTLE_TIMEOUT_MS));
+	CloseHandle(hDone);
+
+	if (0 == (cycle % 100))
+		PublishSoakToggleList(cycle / 100);
+}
+
+// TestSoak
+// Takes a baseline after SOAK_WARMUP_CYCLES cycles, runs SOAK_CYCLES more
+// and checks that handles, private bytes, live deadline calls and device list
+// snapshots all come back to where they started
+static void TestSoak()
+{
+	HeadlessClock clock;
+	SimulatedDeviceBackend backend(clock);
+	HeadlessTrayView view(clock);
+	HeadlessTrayDriver driver(backend, view, clock);
+
+	PublishSoakToggleList(0);
+	for (int cycle = 0; cycle < SOAK_WARMUP_CYCLES; cycle++)
+		RunSoakCycle(driver, cycle);
+	CHECK(SettleDeadlineCalls(0));
+	SoakUsage baseline = SampleUsage();
+	std::weak_ptr<const DeviceListSnapshot> firstMeasured = AcquireDeviceList();
+	int setCountBefore = backend.setCount;
+
+	printf("Soak of %d cycles (handles, private bytes over baseline):\n", SOAK_CYCLES);
+	SoakUsage usage = baseline;
+	for (int cycle = 0; cycle < SOAK_CYCLES; cycle++)
+	{
+		RunSoakCycle(driver, SOAK_WARMUP_CYCLES + cycle);
+		if (0 == ((cycle + 1) % SOAK_SAMPLE_CYCLES))
+		{
+			CHECK(SettleDeadlineCalls(baseline.deadlineCalls));
+			usage = SampleUsage();
+			printf("  after %-6d handles=%+ld private=%+lld bytes\n", cycle + 1,
+				(long)usage.handles - (long)baseline.handles,
+				(long long)usage.privateBytes - (long long)baseline.privateBytes);
+		}
+	}
+
+	CHECK(backend.setCount - setCountBefore == SOAK_CYCLES);
+	CHECK(usage.handles <= baseline.handles + SOAK_HANDLE_SLACK);
+	CHECK(usage.privateBytes <= baseline.privateBytes + SOAK_PRIVATE_BYTES_SLACK);
+	CHECK(usage.deadlineCalls == baseline.deadlineCalls);
+	CHECK(0 == GetBackgroundQueueDepth());
+
+	// only the published list and this reference are left holding the
+	// current snapshot, and every earlier one has been freed
+	DeviceListSnapshotPtr current = AcquireDeviceList();
+	CHECK(2 == current.use_count());
+	CHECK(firstMeasured.expired());
+}
+
+// RunSoakTests
+void RunSoakTests()
+{
+	CHECK(0 == StartBackgroundTasks());
+	TestSoak();
+	StopBackgroundTasks(NULL);
+}
@@ -0,0 +1,143 @@
+// ----------------------------------------------------------------------------
+// switchbenchmark.cpp
+// Switch throughput and latency of the double-click path against simulated
+// devices that answer like fast, slow and flaky drivers do
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "headlesstray.h"
+#include "devicelist.h"
+#include "backendwatchdog.h"
+
+// double-clicks run against each latency model
+#define BENCHMARK_SWITCHES		2000
+
+// seed of the simulated devices' draws, so runs can be compared
+#define BENCHMARK_SEED			20150101
+
+// how each kind of device answers, in microseconds
+static const DeviceLatencyModel g_HdaModel = { "HDA", 150, 800, 0.25, 0 };
+static const DeviceLatencyModel g_UsbModel = { "USB", 2000, 25000, 0.5, 0 };
+static const DeviceLatencyModel g_BluetoothModel = { "Bluetooth", 5000, 60000, 0.9, 0.02 };
+
+// SwitchBenchmarkResult
+// What one run of BENCHMARK_SWITCHES double-clicks measured
+struct SwitchBenchmarkResult
+{
+	double switchesPerSecond;		// successful switches per second of clock time
+	int failures;					// switches abandoned by the (simulated) watchdog
+	LatencySummary total;			// input to new icon
+	LatencySummary advance;			// picking the next entry
+	LatencySummary resolve;			// finding its endpoint
+	LatencySummary setDefault;		// making it the default
+	LatencySummary icon;			// classifying it and showing the icon
+};
+
+// RunSwitchBenchmark
+// Double-clicks through a toggle list of two entries per model
+//
+// Parameters:
+//	models	The kinds of device in the toggle list
+//
+// Return values:
+//	What the run measured
+static SwitchBenchmarkResult RunSwitchBenchmark(const std::vector<DeviceLatencyModel>& models)
+{
+	HeadlessClock clock;
+	SimulatedDeviceBackend backend(clock);
+	HeadlessTrayView view(clock);
+	HeadlessTrayDriver driver(backend, view, clock);
+
+	// two entries per model so a double-click always moves between devices
+	std::shared_ptr<DeviceListSnapshot> deviceList = std::make_shared<DeviceListSnapshot>();
+	std::vector<DeviceLatencyModel> entryModels;
+	for (size_t i = 0; i < models.size() * 2; i++)
+	{
+		WCHAR name[64];
+		swprintf_s(name, (i % 2) ? L"Headset %d" : L"Speakers %d", (int)i);
+		deviceList->switchTable.Append(name);
+		entryModels.push_back(models[i / 2]);
+	}
+	deviceList->switchListIndex = 0;
+	PublishDeviceList(deviceList);
+	backend.SetLatencyModels(entryModels, BENCHMARK_SEED);
+
+	SwitchBenchmarkResult result = {};
+	std::vector<double> total, advance, resolve, setDefault, icon;
+	double startTime = clock.Now();
+	int switches = 0;
+	for (int i = 0; i < BENCHMARK_SWITCHES; i++)
+	{
+		TrayEventTiming timing = driver.DoubleClick();
+		advance.push_back(timing.dispatchUs);
+		resolve.push_back(backend.resolveUs);
+		setDefault.push_back(backend.setUs);
+		total.push_back(timing.totalUs);
+		if (timing.feedback)
+		{
+			icon.push_back(timing.iconUs);
+			switches++;
+		}
+		else
+		{
+			result.failures++;
+		}
+	}
+
+	result.switchesPerSecond = switches / ((clock.Now() - startTime) / 1000000.0);
+	result.total = SummarizeLatency(total);
+	result.advance = SummarizeLatency(advance);
+	result.resolve = SummarizeLatency(resolve);
+	result.setDefault = SummarizeLatency(setDefault);
+	result.icon = SummarizeLatency(icon);
+	return result;
+}
+
+// PrintSwitchBenchmark
+// Writes one run's throughput, tail latency and phase breakdown (median/p99)
+static void PrintSwitchBenchmark(const char* name, const SwitchBenchmarkResult& result)
+{
+	printf("  %-10s %8.1f sw/s  fail=%-3d total p50=%8.2fms p99=%8.2fms max=%8.2fms | "
+		"advance %.1f/%.1fus resolve %.2f/%.2fms set %.2f/%.2fms icon %.1f/%.1fus\n",
+		name, result.switchesPerSecond, result.failures,
+		result.total.median / 1000.0, result.total.p99 / 1000.0, result.total.max / 1000.0,
+		result.advance.median, result.advance.p99,
+		result.resolve.median / 1000.0, result.resolve.p99 / 1000.0,
+		result.setDefault.median / 1000.0, result.setDefault.p99 / 1000.0,
+		result.icon.median, result.icon.p99);
+}
+
+// RunSwitchBenchmarks
+// Runs the double-click path against each kind of device and against a list
+// mixing all three.  Device time is simulated, so the run is quick however
+// slow the models are.  Only sanity checks are made; the numbers are printed
+// for comparing builds.
+void RunSwitchBenchmarks()
+{
+	SwitchBenchmarkResult hda = RunSwitchBenchmark(std::vector<DeviceLatencyModel>(1, g_HdaModel));
+	SwitchBenchmarkResult usb = RunSwitchBenchmark(std::vector<DeviceLatencyModel>(1, g_UsbModel));
+	SwitchBenchmarkResult bluetooth = RunSwitchBenchmark(std::vector<DeviceLatencyModel>(1, g_BluetoothModel));
+
+	std::vector<DeviceLatencyModel> mixedModels;
+	mixedModels.push_back(g_HdaModel);
+	mixedModels.push_back(g_UsbModel);
+	mixedModels.push_back(g_BluetoothModel);
+	SwitchBenchmarkResult mixed = RunSwitchBenchmark(mixedModels);
+
+	printf("Switch benchmark, %d double-clicks each:\n", BENCHMARK_SWITCHES);
+	PrintSwitchBenchmark(g_HdaModel.name, hda);
+	PrintSwitchBenchmark(g_UsbModel.name, usb);
+	PrintSwitchBenchmark(g_BluetoothModel.name, bluetooth);
+	PrintSwitchBenchmark("mixed", mixed);
+
+	// the models come through in the measurements
+	CHECK(0 == hda.failures);
+	CHECK(0 == usb.failures);
+	CHECK(bluetooth.failures > 0);
+	CHECK(hda.switchesPerSecond > usb.switchesPerSecond);
+	CHECK(usb.switchesPerSecond > bluetooth.switchesPerSecond);
+	CHECK(bluetooth.total.max >= DEFAULT_BACKEND_DEADLINE_MS * 1000.0);
+	CHECK(usb.setDefault.median > hda.setDefault.median);
+}
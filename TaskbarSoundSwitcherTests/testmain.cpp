@@ -0,0 +1,74 @@
+// ----------------------------------------------------------------------------
+// testmain.cpp
+// Runs the unit tests and stands in for the app modules they don't link
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "devicelist.h"
+#include "statuspublisher.h"
+#include "backendtrace.h"
+
+int g_TestFailures = 0;
+
+
+// PublishStatusBlock
+// The tests publish device lists without a shared memory block to copy to
+void PublishStatusBlock(const DeviceListSnapshot& deviceList)
+{
+}
+
+// IsBackendTraceEnabled
+// Tracing is always off in the tests
+bool IsBackendTraceEnabled()
+{
+	return false;
+}
+
+// BackendTraceTimestamp
+// Tracing is always off in the tests
+LONGLONG BackendTraceTimestamp()
+{
+	return 0;
+}
+
+// BackendTraceElapsedUs
+// Tracing is always off in the tests
+double BackendTraceElapsedUs(LONGLONG startTime)
+{
+	return 0;
+}
+
+// TraceBackendCall
+// Tracing is always off in the tests
+void TraceBackendCall(LPCWSTR operation, LONGLONG startTime, HRESULT hr, LPCWSTR detail)
+{
+}
+
+// main
+// Runs every test and reports the number of failed checks
+//
+// Return values:
+//	0	Every check passed
+//	1	At least one check failed
+int main()
+{
+	RunToggleMatcherTests();
+	RunDeviceAvailabilityTests();
+	RunDeployPolicyTests();
+	RunDeviceListTests();
+	RunBackgroundTaskTests();
+	RunBackendWatchdogTests();
+	RunTrayEventTests();
+	RunSwitchBenchmarks();
+	RunSoakTests();
+
+	if (g_TestFailures)
+	{
+		printf("%d check(s) failed\n", g_TestFailures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,36 @@
+// ----------------------------------------------------------------------------
+// tests.h
+// Checks shared by the unit tests of the app's backend free modules
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#pragma once
+#include "stdafx.h"
+#include <stdio.h>
+
+// number of checks that failed so far
+extern int g_TestFailures;
+
+// CHECK
+// Records a failed check and prints where it is.  Checks keep going after a
+// failure so one run reports everything that is broken.
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			g_TestFailures++; \
+			printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		} \
+	} while (0)
+
+// Routines that run each module's tests
+void RunToggleMatcherTests();
+void RunDeviceAvailabilityTests();
+void RunDeployPolicyTests();
+void RunDeviceListTests();
+void RunBackgroundTaskTests();
+void RunBackendWatchdogTests();
+void RunTrayEventTests();
+void RunSwitchBenchmarks();
+void RunSoakTests();
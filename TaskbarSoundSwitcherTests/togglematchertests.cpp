@@ -0,0 +1,56 @@
+// ----------------------------------------------------------------------------
+// togglematchertests.cpp
+// Tests of matching device names against the toggle list entries
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "tests.h"
+#include "togglematcher.h"
+
+
+// RunToggleMatcherTests
+// Plain entries match anywhere in a name, patterns must match all of it
+void RunToggleMatcherTests()
+{
+	std::vector<std::wstring> entries;
+	entries.push_back(L"Speakers");
+	entries.push_back(L"Speakers (*- Dock Audio)");
+	entries.push_back(L"Head?hones");
+	entries.push_back(L"USB");
+	ToggleMatcher matcher(entries);
+
+	CHECK(4 == matcher.EntryCount());
+
+	// a plain entry is a substring match
+	CHECK(matcher.Matches(L"Speakers", 0));
+	CHECK(matcher.Matches(L"Realtek Speakers (High Definition)", 0));
+	CHECK(!matcher.Matches(L"Speaker", 0));
+	CHECK(0 == matcher.FirstMatch(L"Realtek Speakers"));
+
+	// '*' matches any run, including none, but the pattern covers the whole name
+	CHECK(matcher.Matches(L"Speakers (2- Dock Audio)", 1));
+	CHECK(matcher.Matches(L"Speakers (- Dock Audio)", 1));
+	CHECK(!matcher.Matches(L"Speakers (2- Dock Audio) Extra", 1));
+	CHECK(!matcher.Matches(L"My Speakers (2- Dock Audio)", 1));
+
+	// '?' matches exactly one character
+	CHECK(matcher.Matches(L"Headphones", 2));
+	CHECK(!matcher.Matches(L"Headhones", 2));
+	CHECK(!matcher.Matches(L"USB Headphones", 2));
+	CHECK(2 == matcher.FirstMatch(L"Headphones"));
+
+	// one pass reports every entry a name matches
+	std::vector<bool> matched(matcher.EntryCount(), false);
+	matcher.Match(L"USB Speakers", matched);
+	CHECK(matched[0]);
+	CHECK(!matched[1]);
+	CHECK(!matched[2]);
+	CHECK(matched[3]);
+
+	CHECK(-1 == matcher.FirstMatch(L"HDMI Output"));
+
+	ToggleMatcher empty((std::vector<std::wstring>()));
+	CHECK(0 == empty.EntryCount());
+	CHECK(-1 == empty.FirstMatch(L"Speakers"));
+}
@@ -0,0 +1,179 @@
+// ----------------------------------------------------------------------------
+// trayeventstests.cpp
+// Tests of the tray handlers driven headless, and their input to feedback
+// latency for every tray path
+// @Author: Matt Fife
+// @Copyright 2015
+// ----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "resource.h"
+#include "tests.h"
+#include "headlesstray.h"
+#include "devicelist.h"
+#include "statusblock.h"
+
+// synthetic events fed down each path when timing them
+#define TRAY_LATENCY_EVENTS		1000
+
+
+// PublishTestDeviceList
+// Publishes a toggle list of count entries that alternate between speakers
+// and headsets, starting on entry 0
+//
+// Parameters:
+//	count			Number of entries
+//	availableMask	Availability bitmap of the entries
+//
+// Return values:
+//	none
+static void PublishTestDeviceList(int count, ULONGLONG availableMask)
+{
+	std::shared_ptr<DeviceListSnapshot> deviceList = std::make_shared<DeviceListSnapshot>();
+	for (int i = 0; i < count; i++)
+	{
+		WCHAR name[32];
+		swprintf_s(name, (i % 2) ? L"Headset %d" : L"Speakers %d", i);
+		deviceList->switchTable.Append(name);
+	}
+	deviceList->availableMask = availableMask;
+	deviceList->switchListIndex = 0;
+	PublishDeviceList(deviceList);
+}
+
+// TestDoubleClick
+// A double-click switches to the next available entry and shows its icon;
+// with nothing available it does nothing
+static void TestDoubleClick()
+{
+	HeadlessClock clock;
+	SimulatedDeviceBackend backend(clock);
+	HeadlessTrayView view(clock);
+	HeadlessTrayDriver driver(backend, view, clock);
+
+	// entry 1 is unplugged
+	PublishTestDeviceList(4, 0xD);
+	TrayEventTiming timing = driver.DoubleClick();
+	CHECK(timing.feedback);
+	CHECK(2 == backend.defaultIndex);
+	CHECK(2 == AcquireDeviceList()->switchListIndex);
+	CHECK(DEVICE_ICON_SPEAKERS == view.iconClass);
+
+	driver.DoubleClick();
+	CHECK(3 == backend.defaultIndex);
+	CHECK(DEVICE_ICON_HEADPHONES == view.iconClass);
+
+	driver.DoubleClick();
+	CHECK(0 == backend.defaultIndex);
+	CHECK(3 == view.iconUpdates);
+
+	PublishTestDeviceList(4, 0);
+	timing = driver.DoubleClick();
+	CHECK(!timing.feedback);
+	CHECK(3 == backend.setCount);
+}
+
+// TestRightClick
+// The menu lists the first MAX_MENU_DEVICE_ITEMS entries with their command
+// ids, unplugged ones greyed out
+static void TestRightClick()
+{
+	HeadlessClock clock;
+	SimulatedDeviceBackend backend(clock);
+	HeadlessTrayView view(clock);
+	HeadlessTrayDriver driver(backend, view, clock);
+
+	PublishTestDeviceList(MAX_MENU_DEVICE_ITEMS + 4, ~2ULL);
+	TrayEventTiming timing = driver.RightClick();
+	CHECK(timing.feedback);
+	CHECK(1 == view.menusShown);
+	CHECK(MAX_MENU_DEVICE_ITEMS == view.menu.size());
+	for (int i = 0; i < (int)view.menu.size(); i++)
+	{
+		CHECK(ID_ROOT_ITEM_0 + i == view.menu[i].commandId);
+		CHECK((1 != i) == view.menu[i].available);
+	}
+	CHECK(L"Headset 19" == view.menu[19].name);
+	CHECK(0 == backend.setCount);
+}
+
+// TestMenuCommands
+// Every device command switches to its entry, an unplugged entry isn't
+// switched to, and re-select and quit reach the view
+static void TestMenuCommands()
+{
+	HeadlessClock clock;
+	SimulatedDeviceBackend backend(clock);
+	HeadlessTrayView view(clock);
+	HeadlessTrayDriver driver(backend, view, clock);
+
+	PublishTestDeviceList(MAX_MENU_DEVICE_ITEMS, ~(1ULL << 7));
+	for (int i = 0; i < MAX_MENU_DEVICE_ITEMS; i++)
+	{
+		TrayEventTiming timing = driver.MenuCommand(ID_ROOT_ITEM_0 + i);
+		CHECK((7 != i) == timing.feedback);
+		if (7 != i)
+		{
+			CHECK(i == backend.defaultIndex);
+			CHECK(i == AcquireDeviceList()->switchListIndex);
+		}
+	}
+	CHECK(MAX_MENU_DEVICE_ITEMS - 1 == view.iconUpdates);
+
+	driver.MenuCommand(ID_ROOT_RESELECT);
+	CHECK(1 == view.selectionsShown);
+	CHECK(!view.quit);
+	driver.MenuCommand(ID_ROOT_QUIT);
+	CHECK(view.quit);
+	CHECK(MAX_MENU_DEVICE_ITEMS == backend.setCount);
+}
+
+// PrintLatency
+// Writes one path's input to feedback latency summary
+static void PrintLatency(const char* path, const std::vector<double>& samples)
+{
+	LatencySummary summary = SummarizeLatency(samples);
+	printf("  %-12s n=%-6u median=%8.2fus p95=%8.2fus p99=%8.2fus max=%8.2fus\n",
+		path, (unsigned int)summary.count, summary.median, summary.p95, summary.p99, summary.max);
+}
+
+// TestInputToFeedbackLatency
+// Times every tray path from the synthetic input to what it shows: the
+// double-click, the menu, each of the menu's device commands and re-select.
+// The numbers are the handlers' own overhead, since the backend answers at
+// once; they are printed for comparing builds, not checked.
+static void TestInputToFeedbackLatency()
+{
+	HeadlessClock clock;
+	SimulatedDeviceBackend backend(clock);
+	HeadlessTrayView view(clock);
+	HeadlessTrayDriver driver(backend, view, clock);
+	PublishTestDeviceList(MAX_MENU_DEVICE_ITEMS, ~0ULL);
+
+	std::vector<double> doubleClick, rightClick, menuItem, reselect;
+	for (int i = 0; i < TRAY_LATENCY_EVENTS; i++)
+	{
+		TrayEventTiming timing = driver.DoubleClick();
+		CHECK(timing.feedback);
+		CHECK(timing.dispatchUs + timing.backendUs + timing.iconUs <= timing.totalUs + 0.001);
+		doubleClick.push_back(timing.totalUs);
+
+		rightClick.push_back(driver.RightClick().totalUs);
+		menuItem.push_back(driver.MenuCommand(ID_ROOT_ITEM_0 + (i % MAX_MENU_DEVICE_ITEMS)).totalUs);
+		reselect.push_back(driver.MenuCommand(ID_ROOT_RESELECT).totalUs);
+	}
+
+	printf("Tray input to feedback latency:\n");
+	PrintLatency("double-click", doubleClick);
+	PrintLatency("right-click", rightClick);
+	PrintLatency("menu item", menuItem);
+	PrintLatency("re-select", reselect);
+}
+
+// RunTrayEventTests
+void RunTrayEventTests()
+{
+	TestDoubleClick();
+	TestRightClick();
+	TestMenuCommands();
+	TestInputToFeedbackLatency();
+}